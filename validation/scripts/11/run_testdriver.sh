@@ -1,23 +1,5 @@
 #!/bin/bash
 
-# Function to merge output files together
-# merge "filename"
-function merge() {
-	name=$1; shift; suffixes="$*"
-	for suffix in $suffixes
-	do
-   		tmp=`dirname $name`
-   	 	tmp=$tmp/tmp.txt
-    		firstfile=`ls ${name}.${suffix}.* | head -n1`
-    		# Get header
-    		head -n1 $firstfile > $tmp
-    		sed -i "1d" ${name}.${suffix}.*
-    		cat ${name}.${suffix}.* >> $tmp
-    		mv $tmp ${name}.${suffix}
-    		rm -rf ${name}.${suffix}.*
-	done
-}
-
 configDir=config
 outputDir=validation
 templatesDir=$outputDir/templates
@@ -29,17 +11,60 @@ root=$(pwd)
 libstring=$(ls $root/lib/libfrpc_11_*_?_[cg]pu.so)
 processor=$(basename $libstring | awk -F"_" '{ print $5 }' | awk -F"." '{ print $1 }')
 
-# Usage: ../bin/validate11 enroll|verif|match -c configDir -o outputDir -h outputStem -i inputFile -t numForks -j templatesDir -p cpu|gpu
+# Usage: ../bin/validate11 enroll|verif|match|matrix -c configDir -o outputDir -h outputStem -i inputFile
+#	-t numForks|-T numThreads -j templatesDir [-b batchSize] [-q chunkSize] [-p prefetchDepth] [-s] [-a] [-l]
+#	[-v verifList] [-k tileSize] [-F text|columnar] [-H] [-r] [-P seconds]
 #   enroll|verif|match: task to process
 #	enroll: generate enrollment templates
 #	verif: generate verification templates
 #	match: perform matching of templates
+#	matrix: compare every verification template (created from verifList) with every enrollment
+#	template (created from inputFile), writing outputDir/outputStem.matrix, a binary score matrix
+#	with a row per verification template, converted to the text match log format with
+#	bin/frpcmatrix outputDir/outputStem.matrix outputDir/outputStem.log
 #   configDir: configuration directory
-#   outputDir: directory where output logs are written to
+#   outputDir: directory where output logs are written to; each action also writes
+#	outputStem.<action>.latency, the number of calls to each interface method and their latency
+#	percentiles and throughput, and outputStem.<action>.resources, the CPU time, faults, context
+#	switches and memory (RSS, PSS, shared and private) of the parent and each worker at the end
+#	of each phase
 #   outputStem: the string to prefix the output filename(s) with
-#   inputFile: input file containing images to process (required enroll and verif template creation)
+#   inputFile: input file containing images to process (required enroll and verif template creation),
+#	or pack:FILE to read the images from an image pack built with bin/frpcpack inputFile FILE
 #   numForks: number of processes to fork.
+#   numThreads: number of threads to run in a single process instead of forking;
+#	requires an implementation whose isThreadSafe() returns true.
 #   templatesDir: directory where templates are written to/read from
+#   batchSize: number of images passed to each createTemplates() call, or the maximum number of
+#	consecutive comparisons sharing a verification template passed to each
+#	matchTemplatesBatch() call (optional, default 1).
+#   chunkSize: if set, workers claim chunkSize entries at a time from a shared queue instead of
+#	each processing a fixed share of inputFile, so that no worker sits idle while another
+#	finishes a slow share; the logs are put back in input order (optional, default 0).
+#   prefetchDepth: if set, a background thread in each worker reads and decodes up to prefetchDepth
+#	images ahead of template creation, so that image I/O overlaps the implementation's work
+#	(optional, default 0).
+#   -s: keep templates in one packed store (templates.data and templates.index) in templatesDir
+#	instead of one file per template; enroll, verif and match must all be given -s (optional).
+#   -a: for match, load every template named in inputFile into shared memory before starting
+#	the workers, which then compare templates without reading them (optional).
+#   -l: for match, process the pairs grouped by verification template, then enrollment template,
+#	keeping each group on one worker; the log is put back in input order (optional).
+#   verifList: for matrix, the list the verification templates were created from.
+#   tileSize: for matrix, the number of templates along each side of the tiles workers claim
+#	(optional, default sized so that a tile's templates take about 1 MiB).
+#   -F: for match, write the scores in the text log (default) or as a binary columnar log in
+#	outputDir/outputStem.log.cols.N per worker, converted to the text log with
+#	bin/frpccols outputDir/outputStem.log.cols outputDir/outputStem.log; not with -q or -l (optional).
+#   -H: count cycles, instructions, LLC, branch and dTLB misses around each interface call with
+#	perf_event_open(2) and write outputDir/outputStem.<action>.counters, with instructions per
+#	cycle and misses per call; counters the host does not allow are reported as - (optional).
+#   -r: record a timeline of every worker's interface calls, image reads and decodes and output
+#	writes to outputDir/outputStem.<action>.trace.json, in the Trace Event Format read by
+#	chrome://tracing and Perfetto (optional).
+#   -P: every given number of seconds, print the images, comparisons or matrix cells finished,
+#	items per second, time remaining, failures and the spread of items over the workers to
+#	stderr, naming workers that made no progress since the previous report (optional).
 echo "------------------------------"
 echo " Running 1:1 validation"
 echo "------------------------------"
@@ -54,7 +79,7 @@ retEnroll=$?
 if [[ $retEnroll == 0 ]]; then
 	echo "[SUCCESS]" 
 	# Merge output files together
-	merge $outputDir/$outputStem log
+	bin/frpcmerge log $outputDir/$outputStem.log
 else
 	echo "[ERROR] Enrollment template creation validation (single process) failed"
 	exit
@@ -70,7 +95,7 @@ retEnroll=$?
 if [[ $retEnroll == 0 ]]; then
 	echo "[SUCCESS]"
 	# Merge output files together
-	merge $outputDir/$outputStem log
+	bin/frpcmerge log $outputDir/$outputStem.log
 else
 	echo "[ERROR] Enrollment template creation validation (multiple process) failed.  Please ensure your software is compatible with fork(2)."
 	exit
@@ -83,7 +108,7 @@ retVerif=$?
 if [[ $retVerif == 0 ]]; then
 	echo "[SUCCESS]" 
 	# Merge output files together
-	merge $outputDir/$outputStem log
+	bin/frpcmerge log $outputDir/$outputStem.log
 else
 	echo "[ERROR] Verification template creation validation failed"
 	exit
@@ -97,13 +122,34 @@ retMatch=$?
 if [[ $retMatch == 0 ]]; then
 	echo "[SUCCESS]"
 	# Merge output files together
-	merge $outputDir/$outputStem log
+	bin/frpcmerge log $outputDir/$outputStem.log
 else
 	echo "[ERROR] Match validation failed"
 	exit 
 fi
 
-if [[ $retEnroll != 0 ]] || [[ $retVerif != 0 ]] || [[ $retMatch != 0 ]]; then
+echo -n "Comparing All Templates (Multiple Processes) "
+outputStem=matrix
+bin/validate11 matrix -c $configDir -o $outputDir -h $outputStem -i input/enroll.txt -v input/verif.txt -t $numForks -j $templatesDir && \
+	bin/frpcmatrix $outputDir/$outputStem.matrix $outputDir/$outputStem.log
+retMatrix=$?
+if [[ $retMatrix == 0 ]]; then
+	# Every comparison must score the same as in the match log
+	awk 'NR == FNR { if (FNR > 1) cell[$1 " " $2] = $3 " " $4; next }
+		FNR > 1 && cell[$1 " " $2] != $3 " " $4 { bad++ }
+		END { exit (bad > 0) }' $outputDir/$outputStem.log $outputDir/match.log
+	retMatrix=$?
+fi
+# The matrix outputs are not part of the submission
+rm -f $outputDir/$outputStem.*
+if [[ $retMatrix == 0 ]]; then
+	echo "[SUCCESS]"
+else
+	echo "[ERROR] All-vs-all comparison failed or disagreed with the match log"
+	exit
+fi
+
+if [[ $retEnroll != 0 ]] || [[ $retVerif != 0 ]] || [[ $retMatch != 0 ]] || [[ $retMatrix != 0 ]]; then
 	echo "There were errors during validation.  Please investigate and re-run this script.  Please ensure you've followed the validation instructions in the README.txt file."
 fi
 
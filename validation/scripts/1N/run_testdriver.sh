@@ -1,50 +1,5 @@
 #!/bin/bash
 
-# Function to merge output files together
-# merge "filename"
-function merge() {
-	name=$1; shift; suffixes="$*"
-	for suffix in $suffixes
-	do
-   		tmp=`dirname $name`
-   	 	tmp=$tmp/tmp.txt
-    		firstfile=`ls ${name}.${suffix}.* | head -n1`
-    		# Get header
-    		head -n1 $firstfile > $tmp
-    		sed -i "1d" ${name}.${suffix}.*
-    		cat ${name}.${suffix}.* >> $tmp
-    		mv $tmp ${name}.${suffix}
-    		rm -rf ${name}.${suffix}.*
-	done
-}
-
-# Function to merge edb and manifest files
-# together
-function mergeEDB() {
-	dir=$1
-	edb=$dir/tmp.edb
-	manifest=$dir/tmp.manifest
-	currOffset=0
-	for f in $dir/manifest.*
-	do
-		seq=`basename $f | awk -F"." '{ print $2 }'`
-		while read line
-		do
-			id=`echo $line | awk '{ print $1 }'`
-			size=`echo $line | awk '{ print $2 }'`
-			echo "$id $size $currOffset" >> $manifest
-			currOffset=$((currOffset+size))
-		done < $f	
-		cat $dir/edb.$seq >> $edb
-	done
-	mv $edb $dir/edb
-	mv $manifest $dir/manifest
-
-	# Clean up old files	
-	rm -rf $dir/edb.* $dir/manifest.*
-}
-
-
 configDir=config
 outputDir=validation
 outputStem=validation
@@ -57,14 +12,44 @@ root=$(pwd)
 libstring=$(ls $root/lib/libfrpc_1N_*_?_[cg]pu.so)
 processor=$(basename $libstring | awk -F"_" '{ print $5 }' | awk -F"." '{ print $1 }')
 
-# Usage: ../bin/validate1N enroll|finalize|search -c configDir -e enrollDir -o outputDir -h outputStem -i inputFile -t numForks
+# Usage: ../bin/validate1N enroll|finalize|search -c configDir -e enrollDir -o outputDir -h outputStem -i inputFile
+#	-t numForks|-T numThreads [-b batchSize] [-q chunkSize] [-p prefetchDepth] [-F text|columnar] [-H] [-r]
+#	[-P seconds]
 #   enroll|finalize|search: task to process
 #   configDir: configuration directory
 #   enrollDir: enrollment directory
 #   outputDir: directory where output logs are written to
+#	and where enroll writes the EDB and manifest (edb, manifest) passed to finalize;
+#	each task also writes outputStem.<task>.latency, the number of calls to each interface
+#	method and their latency percentiles and throughput, and outputStem.<task>.resources,
+#	the CPU time, faults, context switches and memory (RSS, PSS, shared and private) of the
+#	parent and each worker at the end of each phase
 #   outputStem: the string to prefix the output filename(s) with
-#   inputFile: input file containing images to process (required for enroll and search tasks)
+#   inputFile: input file containing images to process (required for enroll and search tasks),
+#	or pack:FILE to read the images from an image pack built with bin/frpcpack inputFile FILE
 #   numForks: number of processes to fork.
+#   numThreads: number of threads to run in a single process instead of forking;
+#	requires an implementation whose isThreadSafe() returns true.
+#   batchSize: number of images passed to each createTemplates() call, and number of probe templates
+#	passed to each identifyTemplates() call (optional, default 1).
+#   chunkSize: if set, workers claim chunkSize entries at a time from a shared queue instead of
+#	each processing a fixed share of inputFile, so that no worker sits idle while another
+#	finishes a slow share; the logs are put back in input order (optional, default 0).
+#   prefetchDepth: if set, a background thread in each worker reads and decodes up to prefetchDepth
+#	images ahead of template creation, so that image I/O overlaps the implementation's work
+#	(optional, default 0).
+#   -F: for search, write the candidate lists in the text log (default) or as a binary columnar log
+#	in outputDir/outputStem.search.cols.N per worker, converted to the text log with
+#	bin/frpccols outputDir/outputStem.search.cols outputDir/outputStem.search; not with -q (optional).
+#   -H: count cycles, instructions, LLC, branch and dTLB misses around each interface call with
+#	perf_event_open(2) and write outputDir/outputStem.<task>.counters, with instructions per cycle
+#	and misses per call; counters the host does not allow are reported as - (optional).
+#   -r: record a timeline of every worker's interface calls, image reads and decodes and output
+#	writes to outputDir/outputStem.<task>.trace.json, in the Trace Event Format read by
+#	chrome://tracing and Perfetto (optional).
+#   -P: every given number of seconds, print the images or probes finished, items per second,
+#	time remaining, failures and the spread of items over the workers to stderr, naming
+#	workers that made no progress since the previous report (optional).
 echo "------------------------------"
 echo " Running 1:N validation"
 echo "------------------------------"
@@ -80,9 +65,7 @@ retEnrollment=$?
 if [ $retEnrollment -eq 0 ]; then
 	echo "[SUCCESS]"
 	# Merge output files together
-	merge $outputDir/$outputStem enroll
-	# Merge edb and manifest together
-	mergeEDB $outputDir
+	bin/frpcmerge log $outputDir/$outputStem.enroll
 else
 	echo "[ERROR] Enrollment validation (single process) failed"
 	exit
@@ -103,9 +86,7 @@ retEnrollment=$?
 if [ $retEnrollment -eq 0 ]; then
 	echo "[SUCCESS]"
 	# Merge output files together
-	merge $outputDir/$outputStem enroll
-	# Merge edb and manifest together
-	mergeEDB $outputDir
+	bin/frpcmerge log $outputDir/$outputStem.enroll
 else
 	echo "[ERROR] Enrollment validation (multiple processes) failed.
 		Please ensure your software is compatible with fork(2)."
@@ -132,7 +113,7 @@ retSearch=$?
 if [ $retSearch -eq 0 ]; then
 	echo "[SUCCESS]"
 	# Merge output files together
-	merge $outputDir/$outputStem search
+	bin/frpcmerge log $outputDir/$outputStem.search
 else
 	echo "[ERROR] Search (multiple processes) validation failed" 
 	exit
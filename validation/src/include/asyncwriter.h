@@ -0,0 +1,128 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef ASYNCWRITER_H_
+#define ASYNCWRITER_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Size, in bytes, of each buffer of an AsyncWriter */
+const size_t AsyncWriterBufferSize = 1 << 20;
+/** Number of buffers of an AsyncWriter */
+const size_t AsyncWriterBuffers = 4;
+
+/**
+ * @brief
+ * Stream buffer that hands full buffers to a background thread, which
+ * writes them to a file
+ *
+ * @details
+ * The writing thread never waits for the disk unless every buffer is
+ * waiting to be written.  sync() hands over the current buffer without
+ * waiting for it to be written.
+ */
+class AsyncWriteBuffer : public std::streambuf {
+public:
+    AsyncWriteBuffer();
+    ~AsyncWriteBuffer();
+
+    bool
+    open(const std::string &file);
+
+    bool
+    is_open() const;
+
+    /* Writes everything buffered, stops the thread and closes the file */
+    bool
+    close();
+
+protected:
+    int_type
+    overflow(int_type c) override;
+
+    int
+    sync() override;
+
+private:
+    AsyncWriteBuffer(const AsyncWriteBuffer&) = delete;
+    AsyncWriteBuffer &operator=(const AsyncWriteBuffer&) = delete;
+
+    /* Queues the current buffer for writing, and optionally waits for a free one */
+    void
+    handOff(bool next);
+
+    /* Body of the background thread */
+    void
+    writeBehind();
+
+    std::string file;
+    int fd;
+    std::vector<std::vector<char>> buffers;
+    std::vector<size_t> lengths;
+    size_t current;
+    std::deque<size_t> freeBuffers;
+    std::deque<size_t> fullBuffers;
+    bool stopping;
+    bool failed;
+    std::mutex mutex;
+    std::condition_variable queued;
+    std::condition_variable released;
+    std::thread thread;
+};
+
+/**
+ * @brief
+ * Output file stream whose writes are done by a background thread
+ *
+ * @details
+ * Used for the per-worker logs, which are written a line at a time.
+ * Lines should end in '\n' rather than std::endl, which would hand over
+ * a buffer per line.  The file is complete once close() returns.
+ */
+class AsyncWriter : public std::ostream {
+public:
+    AsyncWriter();
+
+    /** @brief This function creates or truncates a file for writing
+     *
+     * @param[in] file
+     * Path of the file
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    open(const std::string &file);
+
+    /** @brief This function returns whether a file is open */
+    bool
+    is_open() const;
+
+    /** @brief This function writes everything buffered and closes the file
+     *
+     * @return
+     * true if every write succeeded; false otherwise
+     */
+    bool
+    close();
+
+private:
+    AsyncWriteBuffer buffer;
+};
+
+#endif /* ASYNCWRITER_H_ */
@@ -0,0 +1,270 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef COLUMNAR_H_
+#define COLUMNAR_H_
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "asyncwriter.h"
+
+/*
+ * A columnar log holds the same rows as a text log in binary form: a
+ * ColumnarHeader, then ColumnarHeader::numColumns ColumnDescriptor
+ * records, then blocks of up to ColumnarBlockRows rows.  Each block is a
+ * ColumnarBlockHeader, then the strings first used in the block, each
+ * NUL-terminated, then every column of the block in turn, each a packed
+ * array of rows fixed-width values.  The strings of every block, in
+ * order, form the log's string table; a String column holds the index
+ * of its string in that table.  The string bytes and every column are
+ * padded to a multiple of ColumnarAlignment bytes.  Integers and doubles
+ * are stored in host byte order.
+ */
+
+/** Magic number at the start of every columnar log */
+const char ColumnarMagic[8] = {'F', 'R', 'P', 'C', 'C', 'O', 'L', 'S'};
+/** Version of the columnar log layout */
+const uint32_t ColumnarVersion = 1;
+/** Maximum number of rows in a block */
+const uint32_t ColumnarBlockRows = 1 << 16;
+/** Alignment, in bytes, of the string bytes and columns of a block */
+const uint64_t ColumnarAlignment = 8;
+
+/** Type of the values of a column */
+enum class ColumnType : uint8_t {
+    /** uint8_t */
+    UInt8 = 1,
+    /** uint32_t */
+    UInt32 = 2,
+    /** double */
+    Float64 = 3,
+    /** uint32_t index into the string table */
+    String = 4
+};
+
+/**
+ * @brief
+ * Header at the start of a columnar log
+ */
+struct ColumnarHeader {
+    /** ColumnarMagic */
+    char magic[8];
+    /** ColumnarVersion */
+    uint32_t version;
+    /** Number of ColumnDescriptor records that follow */
+    uint32_t numColumns;
+    uint8_t reserved[48];
+};
+
+/**
+ * @brief
+ * Name and type of one column of a columnar log
+ */
+struct ColumnDescriptor {
+    /** NUL-terminated name, as in the header line of the text log */
+    char name[31];
+    /** ColumnType */
+    ColumnType type;
+};
+
+/**
+ * @brief
+ * Header at the start of each block of a columnar log
+ */
+struct ColumnarBlockHeader {
+    /** Number of rows */
+    uint32_t rows;
+    /** Number of strings added to the string table */
+    uint32_t numStrings;
+    /** Number of bytes of the new strings, before padding */
+    uint64_t stringBytes;
+};
+
+static_assert(sizeof(ColumnarHeader) == 64, "ColumnarHeader must be 64 bytes");
+static_assert(sizeof(ColumnDescriptor) == 32, "ColumnDescriptor must be 32 bytes");
+static_assert(sizeof(ColumnarBlockHeader) == 16,
+        "ColumnarBlockHeader must be 16 bytes");
+
+/** @brief This function returns the columns of a 1:N candidate list log */
+std::vector<ColumnDescriptor>
+candidateListColumns();
+
+/** @brief This function returns the columns of a 1:1 scores log */
+std::vector<ColumnDescriptor>
+scoreColumns();
+
+/**
+ * @brief
+ * Writer of a columnar log, one row at a time
+ *
+ * @details
+ * Every column of a row is set, in any order, then the row is ended.
+ * Blocks are written by a background thread through an AsyncWriter.
+ */
+class ColumnWriter {
+public:
+    ColumnWriter();
+
+    /** @brief This function creates a columnar log
+     *
+     * @param[in] file
+     * Path of the log
+     * @param[in] columns
+     * The columns of every row
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    open(
+            const std::string &file,
+            const std::vector<ColumnDescriptor> &columns);
+
+    /** @brief This function sets a UInt8 or UInt32 column of the row */
+    void
+    setInteger(
+            size_t column,
+            uint32_t value);
+
+    /** @brief This function sets a Float64 column of the row */
+    void
+    setDouble(
+            size_t column,
+            double value);
+
+    /** @brief This function sets a String column of the row */
+    void
+    setString(
+            size_t column,
+            const std::string &value);
+
+    /** @brief This function ends the row */
+    void
+    endRow();
+
+    /** @brief This function writes the last block and closes the log
+     *
+     * @return
+     * true if every write succeeded; false otherwise
+     */
+    bool
+    close();
+
+private:
+    void
+    writeBlock();
+
+    std::vector<ColumnDescriptor> columns;
+    std::vector<std::vector<uint8_t>> values;
+    uint32_t rows;
+    std::unordered_map<std::string, uint32_t> stringIndex;
+    std::string newStrings;
+    uint32_t numNewStrings;
+    AsyncWriter stream;
+};
+
+/**
+ * @brief
+ * Reader of a columnar log, one block at a time
+ */
+class ColumnReader {
+public:
+    ColumnReader();
+
+    /** @brief This function maps a columnar log for reading
+     *
+     * @param[in] file
+     * Path of the log
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    open(const std::string &file);
+
+    /** @brief This function returns the columns of the log */
+    const std::vector<ColumnDescriptor>&
+    columns() const;
+
+    /** @brief This function moves to the next block
+     *
+     * @return
+     * true if there is a next block; false at the end of the log or if
+     * the block is truncated or corrupt, in which case error() is true
+     */
+    bool
+    nextBlock();
+
+    /** @brief This function returns whether the log was found to be
+     * truncated or corrupt */
+    bool
+    error() const;
+
+    /** @brief This function returns the number of rows of the block */
+    uint32_t
+    rows() const;
+
+    /** @brief This function returns the values of a column of the block,
+     * an array of rows() values of the column's type */
+    const void*
+    column(size_t column) const;
+
+    /** @brief This function returns a UInt8 or UInt32 value, or the
+     * string table index of a String value */
+    uint32_t
+    integer(
+            size_t column,
+            uint32_t row) const;
+
+    /** @brief This function returns a Float64 value */
+    double
+    real(
+            size_t column,
+            uint32_t row) const;
+
+    /** @brief This function returns a String value */
+    const char*
+    text(
+            size_t column,
+            uint32_t row) const;
+
+    /** @brief This function writes the header line of the text log */
+    void
+    writeTextHeader(std::ostream &stream) const;
+
+    /** @brief This function writes a row of the block as a line of the
+     * text log */
+    void
+    writeTextRow(
+            std::ostream &stream,
+            uint32_t row) const;
+
+private:
+    bool
+    fail(const std::string &reason);
+
+    std::string file;
+    std::shared_ptr<uint8_t> mapping;
+    size_t length;
+    std::vector<ColumnDescriptor> descriptors;
+    std::vector<const char*> strings;
+    /* Offset of the next block, and the current block's columns */
+    uint64_t nextOffset;
+    uint32_t blockRows;
+    std::vector<const uint8_t*> blockColumns;
+    bool failed;
+};
+
+#endif /* COLUMNAR_H_ */
@@ -12,6 +12,7 @@
 #define FRPC_H_
 
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -58,6 +59,151 @@ typedef struct Image {
     size() const { return (width * height * (depth / 8)); }
 } Image;
 
+/**
+ * @brief
+ * Struct representing a non-owning view of a single image
+ *
+ * @details
+ * The pixels are owned by the caller, for example a memory-mapped file or
+ * a caller-supplied buffer, and remain valid only for the duration of the
+ * call that receives the view.  Rows may be padded, in which case stride
+ * is larger than the number of bytes in a row of pixels.
+ */
+typedef struct ImageView {
+    /** Number of pixels horizontally */
+    uint16_t width;
+    /** Number of pixels vertically */
+    uint16_t height;
+    /** Number of bits per pixel. Legal values are 8 and 24. */
+    uint8_t depth;
+    /** Number of bytes from the start of one row to the start of the next */
+    size_t stride;
+    /** Pointer to the first pixel of the first row.
+     * Either RGB color or intensity, laid out as for Image. */
+    const uint8_t *data;
+
+    ImageView() :
+        width{0},
+        height{0},
+        depth{24},
+        stride{0},
+        data{nullptr}
+        {}
+
+    /**
+     * @brief
+     * Create a view of caller-owned pixels.
+     *
+     * @param[in] stride
+     * The number of bytes between rows, or 0 if the rows are contiguous.
+     */
+    ImageView(
+        uint16_t width,
+        uint16_t height,
+        uint8_t depth,
+        const uint8_t *data,
+        size_t stride = 0
+        ) :
+        width{width},
+        height{height},
+        depth{depth},
+        stride{stride != 0 ? stride : (size_t)width * (depth / 8)},
+        data{data}
+        {}
+
+    /** @brief Create a view of the pixels owned by an Image. */
+    explicit ImageView(
+        const Image &image
+        ) :
+        width{image.width},
+        height{image.height},
+        depth{image.depth},
+        stride{(size_t)image.width * (image.depth / 8)},
+        data{image.data.get()}
+        {}
+
+    /** @brief This function returns the size of one row of pixels. */
+    size_t
+    rowSize() const { return (width * (depth / 8)); }
+
+    /** @brief This function returns the size of the image data
+     * without row padding. */
+    size_t
+    size() const { return (rowSize() * height); }
+
+    /** @brief This function returns whether the rows are stored
+     * without padding. */
+    bool
+    isContiguous() const { return (stride == rowSize()); }
+} ImageView;
+
+/**
+ * @brief
+ * Adapt an ImageView to an Image.
+ *
+ * @details
+ * When the rows of the view are contiguous, the returned Image points
+ * directly at the viewed pixels without copying or owning them, so it must
+ * not outlive them and its pixels must not be modified.  Otherwise, the rows
+ * are copied into a new buffer owned by the returned Image.
+ */
+inline Image
+toImage(const ImageView &view)
+{
+    if (view.isContiguous())
+        return (Image(view.width, view.height, view.depth,
+            std::shared_ptr<uint8_t>(const_cast<uint8_t*>(view.data),
+            [](uint8_t*) {})));
+
+    std::shared_ptr<uint8_t> data(new uint8_t[view.size()],
+        std::default_delete<uint8_t[]>());
+    for (size_t row = 0; row < view.height; row++)
+        std::memcpy(data.get() + row * view.rowSize(),
+            view.data + row * view.stride, view.rowSize());
+    return (Image(view.width, view.height, view.depth, data));
+}
+
+/**
+ * @brief
+ * Struct representing a non-owning view of a template
+ *
+ * @details
+ * The bytes are owned by the caller, for example an arena of templates
+ * preloaded by the NIST calling application, and remain valid only for the
+ * duration of the call that receives the view.
+ */
+typedef struct TemplateView {
+    /** Pointer to the first byte of the template */
+    const uint8_t *data;
+    /** Size of the template in bytes */
+    size_t size;
+
+    TemplateView() :
+        data{nullptr},
+        size{0}
+        {}
+
+    TemplateView(
+        const uint8_t *data,
+        size_t size
+        ) :
+        data{data},
+        size{size}
+        {}
+
+    /** @brief Create a view of the bytes owned by a vector. */
+    explicit TemplateView(
+        const std::vector<uint8_t> &templ
+        ) :
+        data{templ.data()},
+        size{templ.size()}
+        {}
+
+    /** @brief This function returns a copy of the viewed bytes. */
+    std::vector<uint8_t>
+    toVector() const { return (std::vector<uint8_t>(data, data + size)); }
+} TemplateView;
+
 
 /** Labels describing the type/role of the template
  * to be generated (provided as input to template generation)
@@ -336,6 +482,89 @@ public:
         std::vector<uint8_t> &templ,
         EyePair &eyeCoordinates) = 0;
 
+    /**
+     * @brief This function takes an ImageView and outputs a template.
+     *
+     * @details This function behaves exactly like createTemplate() for an
+     * Image, but receives pixels that are owned by the NIST calling
+     * application, for example rows inside a memory-mapped file, and that
+     * may be padded.  The default implementation adapts the view with
+     * toImage() and calls createTemplate() for an Image, so implementations
+     * need only override it to consume such pixels without a copy.
+     * Implementations that override either overload should bring the other
+     * into scope with <tt>using IdentInterface::createTemplate;</tt>.
+     *
+     * @param[in] face
+     * A view of the input face image, valid for the duration of the call.
+     * @param[in] role
+     * Label describing the type/role of the template to be generated.
+     * @param[out] templ
+     * The output template, as for createTemplate() for an Image.
+     * @param[out] eyeCoordinates
+     * The estimated eye centers, as for createTemplate() for an Image.
+     */
+    virtual ReturnStatus
+    createTemplate(
+        const ImageView &face,
+        TemplateRole role,
+        std::vector<uint8_t> &templ,
+        EyePair &eyeCoordinates)
+    {
+        return this->createTemplate(toImage(face), role, templ,
+            eyeCoordinates);
+    }
+
+    /**
+     * @brief This function takes a batch of Images and outputs one template
+     * per image.
+     *
+     * @details This function allows the implementation to process several
+     * images in one call, for example to fill a batch on a neural network
+     * accelerator.  The NIST calling application may call this function
+     * instead of createTemplate().  Each output shall be what createTemplate()
+     * would have produced for the corresponding input image, and everything
+     * stated for createTemplate() applies to each element.
+     * The default implementation calls createTemplate() once per image, so
+     * implementations that do not benefit from batching need not override it.
+     *
+     * @param[in] faces
+     * The input face images.
+     * @param[in] role
+     * A value from the TemplateRole enumeration that indicates the intended
+     * usage of the templates to be generated.  It applies to every image
+     * in the batch.
+     * @param[out] templs
+     * The output templates, one per input image and in the same order.  This
+     * will be an empty vector when passed into the function.
+     * @param[out] eyeCoordinates
+     * The estimated eye centers, one per input image and in the same order.
+     * This will be an empty vector when passed into the function.
+     * @param[out] status
+     * The return status of template creation for each input image, in the
+     * same order.  This will be an empty vector when passed into the function.
+     *
+     * @return
+     * A non-successful return status indicates that the batch as a whole
+     * could not be processed, in which case every image in the batch is
+     * treated as having failed with that status.
+     */
+    virtual ReturnStatus
+    createTemplates(
+        const std::vector<Image> &faces,
+        TemplateRole role,
+        std::vector<std::vector<uint8_t>> &templs,
+        std::vector<EyePair> &eyeCoordinates,
+        std::vector<ReturnStatus> &status)
+    {
+        templs.resize(faces.size());
+        eyeCoordinates.resize(faces.size());
+        status.resize(faces.size());
+        for (size_t i = 0; i < faces.size(); i++)
+            status[i] = this->createTemplate(
+                faces[i], role, templs[i], eyeCoordinates[i]);
+        return ReturnStatus(ReturnCode::Success);
+    }
+
     /**
      * @brief This function will be called after all enrollment templates have
      * been created and freezes the enrollment data.
@@ -455,6 +684,60 @@ public:
         std::vector<Candidate> &candidateList,
         bool &decision) = 0;
 
+    /** @brief This function searches several identification templates
+     * against the enrollment set, and outputs one candidate list and
+     * decision per template.
+     *
+     * @details This function allows the implementation to scan the
+     * enrollment set once for several searches, for example by tiling the
+     * gallery so that each block is compared against every template while
+     * it is resident in cache.  The NIST calling application may call this
+     * function instead of identifyTemplate().  Each candidate list,
+     * decision and status shall be what identifyTemplate() would have
+     * produced for the corresponding template.  The default implementation
+     * calls identifyTemplate() once per template.
+     *
+     * @param[in] idTemplates
+     * Pointers to templates from createTemplate() for which the value
+     * returned was successful.  The pointers are valid for the duration of
+     * the call.
+     * @param[in] candidateListLength
+     * The number of candidates each search should return.
+     * @param[out] candidateLists
+     * One candidate list per template, in the same order.  This will be an
+     * empty vector when passed into the function.
+     * @param[out] decisions
+     * One mate decision per template, in the same order.  This will be an
+     * empty vector when passed into the function.
+     * @param[out] status
+     * One return status per template, in the same order.  This will be an
+     * empty vector when passed into the function.
+     *
+     * @return
+     * A non-successful return status indicates that the batch as a whole
+     * could not be processed, in which case every search in the batch is
+     * treated as having failed with that status.
+     */
+    virtual ReturnStatus
+    identifyTemplates(
+        const std::vector<const std::vector<uint8_t>*> &idTemplates,
+        const uint32_t candidateListLength,
+        std::vector<std::vector<Candidate>> &candidateLists,
+        std::vector<bool> &decisions,
+        std::vector<ReturnStatus> &status)
+    {
+        candidateLists.resize(idTemplates.size());
+        decisions.assign(idTemplates.size(), false);
+        status.resize(idTemplates.size());
+        for (size_t i = 0; i < idTemplates.size(); i++) {
+            bool decision = false;
+            status[i] = this->identifyTemplate(*idTemplates[i],
+                candidateListLength, candidateLists[i], decision);
+            decisions[i] = decision;
+        }
+        return ReturnStatus(ReturnCode::Success);
+    }
+
     /**
      * @brief This function sets the GPU device number to be used by all
      * subsequent implementation function calls.  gpuNum is a zero-based
@@ -468,6 +751,21 @@ public:
     virtual ReturnStatus
     setGPU(uint8_t gpuNum) = 0;
 
+    /**
+     * @brief This function reports whether the implementation supports
+     * concurrent calls from several threads.
+     *
+     * @details When this function returns true, the NIST calling application
+     * may call createTemplate(), createTemplates(), identifyTemplate() and
+     * identifyTemplates() from several threads of one process at the same
+     * time, on the single object returned by getImplementation(), once the
+     * initialization functions have returned.  Otherwise, the NIST calling
+     * application parallelizes only via fork().  The default implementation
+     * returns false.
+     */
+    virtual bool
+    isThreadSafe() const { return false; }
+
     /**
      * @brief
      * Factory method to return a managed pointer to the IdentInterface
@@ -543,6 +841,89 @@ public:
         std::vector<uint8_t> &templ,
         EyePair &eyeCoordinates) = 0;
 
+    /**
+     * @brief This function takes an ImageView and outputs a template.
+     *
+     * @details This function behaves exactly like createTemplate() for an
+     * Image, but receives pixels that are owned by the NIST calling
+     * application, for example rows inside a memory-mapped file, and that
+     * may be padded.  The default implementation adapts the view with
+     * toImage() and calls createTemplate() for an Image, so implementations
+     * need only override it to consume such pixels without a copy.
+     * Implementations that override either overload should bring the other
+     * into scope with <tt>using VerifInterface::createTemplate;</tt>.
+     *
+     * @param[in] face
+     * A view of the input face image, valid for the duration of the call.
+     * @param[in] role
+     * Label describing the type/role of the template to be generated.
+     * @param[out] templ
+     * The output template, as for createTemplate() for an Image.
+     * @param[out] eyeCoordinates
+     * The estimated eye centers, as for createTemplate() for an Image.
+     */
+    virtual ReturnStatus
+    createTemplate(
+        const ImageView &face,
+        TemplateRole role,
+        std::vector<uint8_t> &templ,
+        EyePair &eyeCoordinates)
+    {
+        return this->createTemplate(toImage(face), role, templ,
+            eyeCoordinates);
+    }
+
+    /**
+     * @brief This function takes a batch of Images and outputs one template
+     * per image.
+     *
+     * @details This function allows the implementation to process several
+     * images in one call, for example to fill a batch on a neural network
+     * accelerator.  The NIST calling application may call this function
+     * instead of createTemplate().  Each output shall be what createTemplate()
+     * would have produced for the corresponding input image, and everything
+     * stated for createTemplate() applies to each element.
+     * The default implementation calls createTemplate() once per image, so
+     * implementations that do not benefit from batching need not override it.
+     *
+     * @param[in] faces
+     * The input face images.
+     * @param[in] role
+     * A value from the TemplateRole enumeration that indicates the intended
+     * usage of the templates to be generated.  It applies to every image
+     * in the batch.
+     * @param[out] templs
+     * The output templates, one per input image and in the same order.  This
+     * will be an empty vector when passed into the function.
+     * @param[out] eyeCoordinates
+     * The estimated eye centers, one per input image and in the same order.
+     * This will be an empty vector when passed into the function.
+     * @param[out] status
+     * The return status of template creation for each input image, in the
+     * same order.  This will be an empty vector when passed into the function.
+     *
+     * @return
+     * A non-successful return status indicates that the batch as a whole
+     * could not be processed, in which case every image in the batch is
+     * treated as having failed with that status.
+     */
+    virtual ReturnStatus
+    createTemplates(
+        const std::vector<Image> &faces,
+        TemplateRole role,
+        std::vector<std::vector<uint8_t>> &templs,
+        std::vector<EyePair> &eyeCoordinates,
+        std::vector<ReturnStatus> &status)
+    {
+        templs.resize(faces.size());
+        eyeCoordinates.resize(faces.size());
+        status.resize(faces.size());
+        for (size_t i = 0; i < faces.size(); i++)
+            status[i] = this->createTemplate(
+                faces[i], role, templs[i], eyeCoordinates[i]);
+        return ReturnStatus(ReturnCode::Success);
+    }
+
     /**
      * @brief This function compares two proprietary templates and outputs a
      * similarity score, which need not satisfy the metric properties. When
@@ -569,6 +950,128 @@ public:
         const std::vector<uint8_t> &enrollTemplate,
         double &similarity) = 0;
 
+    /**
+     * @brief This function compares two templates passed as views and
+     * outputs a similarity score.
+     *
+     * @details The requirements are those of matchTemplates() for
+     * vectors.  The NIST calling application may call this function when
+     * the templates are already in memory it owns, such as a preloaded
+     * arena.  The default implementation copies both templates into vectors
+     * and calls matchTemplates() for vectors, so implementations that can
+     * read templates in place should override it.
+     *
+     * param[in] verifTemplate
+     * A view of a verification template from
+     * createTemplate(role=Verification_11).
+     * param[in] enrollTemplate
+     * A view of an enrollment template from
+     * createTemplate(role=Enrollment_11).
+     * param[out] similarity
+     * A similarity score resulting from comparison of the templates,
+     * on the range [0,DBL_MAX].
+     */
+    virtual ReturnStatus
+    matchTemplates(
+        const TemplateView &verifTemplate,
+        const TemplateView &enrollTemplate,
+        double &similarity)
+    {
+        return this->matchTemplates(verifTemplate.toVector(),
+            enrollTemplate.toVector(), similarity);
+    }
+
+    /**
+     * @brief This function compares one verification template against
+     * several enrollment templates and outputs one similarity score per
+     * enrollment template.
+     *
+     * @details This function allows the implementation to decode the
+     * verification template once and to vectorize the comparison across
+     * the enrollment templates.  The NIST calling application may call this
+     * function instead of matchTemplates() when several comparisons share a
+     * verification template.  Each score and status shall be what
+     * matchTemplates() would have produced for the corresponding pair,
+     * including the requirements for templates that are the result of a
+     * failed template generation.  The default implementation calls
+     * matchTemplates() once per enrollment template.
+     *
+     * param[in] verifTemplate
+     * A verification template from createTemplate(role=Verification_11).
+     * param[in] enrollTemplates
+     * Pointers to enrollment templates from
+     * createTemplate(role=Enrollment_11).  The pointers are valid for the
+     * duration of the call.
+     * param[out] similarities
+     * One similarity score per enrollment template, in the same order.
+     * This will be an empty vector when passed into the function.
+     * param[out] status
+     * One return status per enrollment template, in the same order.
+     * This will be an empty vector when passed into the function.
+     *
+     * @return
+     * A non-successful return status indicates that the batch as a whole
+     * could not be processed, in which case every comparison in the batch
+     * is treated as having failed with that status.
+     */
+    virtual ReturnStatus
+    matchTemplatesBatch(
+        const std::vector<uint8_t> &verifTemplate,
+        const std::vector<const std::vector<uint8_t>*> &enrollTemplates,
+        std::vector<double> &similarities,
+        std::vector<ReturnStatus> &status)
+    {
+        similarities.assign(enrollTemplates.size(), -1.0);
+        status.resize(enrollTemplates.size());
+        for (size_t i = 0; i < enrollTemplates.size(); i++)
+            status[i] = this->matchTemplates(
+                verifTemplate, *enrollTemplates[i], similarities[i]);
+        return ReturnStatus(ReturnCode::Success);
+    }
+
+    /**
+     * @brief This function compares a view of one verification template
+     * against views of several enrollment templates and outputs one
+     * similarity score per enrollment template.
+     *
+     * @details The requirements are those of matchTemplatesBatch() for
+     * vectors.  The default implementation calls matchTemplates() for
+     * views once per enrollment template, without copying the templates,
+     * so implementations that override matchTemplatesBatch() for vectors
+     * should override this function too.
+     *
+     * param[in] verifTemplate
+     * A view of a verification template from
+     * createTemplate(role=Verification_11).
+     * param[in] enrollTemplates
+     * Views of enrollment templates from createTemplate(role=Enrollment_11).
+     * param[out] similarities
+     * One similarity score per enrollment template, in the same order.
+     * This will be an empty vector when passed into the function.
+     * param[out] status
+     * One return status per enrollment template, in the same order.
+     * This will be an empty vector when passed into the function.
+     *
+     * @return
+     * A non-successful return status indicates that the batch as a whole
+     * could not be processed, in which case every comparison in the batch
+     * is treated as having failed with that status.
+     */
+    virtual ReturnStatus
+    matchTemplatesBatch(
+        const TemplateView &verifTemplate,
+        const std::vector<TemplateView> &enrollTemplates,
+        std::vector<double> &similarities,
+        std::vector<ReturnStatus> &status)
+    {
+        similarities.assign(enrollTemplates.size(), -1.0);
+        status.resize(enrollTemplates.size());
+        for (size_t i = 0; i < enrollTemplates.size(); i++)
+            status[i] = this->matchTemplates(
+                verifTemplate, enrollTemplates[i], similarities[i]);
+        return ReturnStatus(ReturnCode::Success);
+    }
+
     /**
      * @brief This function sets the GPU device number to be used by all
      * subsequent implementation function calls.  gpuNum is a zero-based
@@ -582,6 +1085,21 @@ public:
     virtual ReturnStatus
     setGPU(uint8_t gpuNum) = 0;
 
+    /**
+     * @brief This function reports whether the implementation supports
+     * concurrent calls from several threads.
+     *
+     * @details When this function returns true, the NIST calling application
+     * may call createTemplate(), createTemplates(), matchTemplates() and
+     * matchTemplatesBatch(), for vectors or views, from several threads of
+     * one process at the same time, on the single object returned by
+     * getImplementation(), once the initialization functions have
+     * returned.  Otherwise, the NIST calling application parallelizes only
+     * via fork().  The default implementation returns false.
+     */
+    virtual bool
+    isThreadSafe() const { return false; }
+
     /**
      * @brief
      * Factory method to return a managed pointer to the VerifInterface object.
@@ -0,0 +1,217 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef IMAGEPACK_H_
+#define IMAGEPACK_H_
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frpc.h"
+
+/*
+ * An image pack holds the decoded images of an input list in a single
+ * file: a PackHeader, then PackHeader::count fixed-size PackEntry records,
+ * then the raw rasters, each starting on a PackAlignment-byte boundary.
+ * Integers are stored in host byte order.
+ */
+
+/** Magic number at the start of every image pack */
+const char PackMagic[8] = {'F', 'R', 'P', 'C', 'P', 'A', 'C', 'K'};
+/** Version of the image pack layout */
+const uint32_t PackVersion = 1;
+/** Alignment, in bytes, of every raster within an image pack */
+const uint64_t PackAlignment = 64;
+/** Prefix of a driver input file argument that names an image pack */
+const char PackInputPrefix[] = "pack:";
+
+/**
+ * @brief
+ * Header at the start of an image pack
+ */
+struct PackHeader {
+    /** PackMagic */
+    char magic[8];
+    /** PackVersion */
+    uint32_t version;
+    /** sizeof(PackEntry) */
+    uint32_t entrySize;
+    /** Number of images */
+    uint64_t count;
+    /** Offset of the first PackEntry */
+    uint64_t indexOffset;
+    /** Offset of the first raster */
+    uint64_t dataOffset;
+    uint8_t reserved[24];
+};
+
+/**
+ * @brief
+ * Index record describing one image of an image pack
+ */
+struct PackEntry {
+    /** NUL-terminated identifier from the input list */
+    char id[64];
+    /** NUL-terminated image path from the input list */
+    char path[168];
+    /** Number of pixels horizontally */
+    uint16_t width;
+    /** Number of pixels vertically */
+    uint16_t height;
+    /** Number of bits per pixel */
+    uint8_t depth;
+    uint8_t reserved[3];
+    /** Offset of the raster from the start of the pack */
+    uint64_t offset;
+    /** Size of the raster in bytes */
+    uint64_t size;
+};
+
+static_assert(sizeof(PackHeader) == 64, "PackHeader must be 64 bytes");
+static_assert(sizeof(PackEntry) == 256, "PackEntry must be 256 bytes");
+
+/**
+ * @brief
+ * Read-only, memory-mapped image pack
+ */
+class ImagePack {
+public:
+    ImagePack();
+
+    /** @brief This function maps an image pack and validates its index
+     *
+     * @param[in] file
+     * Path to the image pack
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    open(const std::string &file);
+
+    /** @brief This function returns the number of images in the pack */
+    uint64_t
+    size() const;
+
+    /** @brief This function returns the identifier of image i */
+    std::string
+    id(uint64_t i) const;
+
+    /** @brief This function returns the original path of image i */
+    std::string
+    path(uint64_t i) const;
+
+    /** @brief This function points an Image at the raster of image i
+     *
+     * @details No pixels are copied.  The image data keeps the mapping
+     * alive for as long as it is referenced.
+     *
+     * @param[in] i
+     * Index of the image within the pack
+     * @param[out] image
+     * The populated FRPC::Image
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    readImage(
+            uint64_t i,
+            FRPC::Image &image) const;
+
+private:
+    std::shared_ptr<uint8_t> mapping;
+    size_t length;
+    const PackHeader *header;
+    const PackEntry *entries;
+};
+
+/**
+ * @brief
+ * Writes an image pack one image at a time
+ *
+ * @details
+ * Rasters are written as images are added; the header and index are
+ * written by close().
+ */
+class PackWriter {
+public:
+    PackWriter();
+
+    /** @brief This function creates an image pack
+     *
+     * @param[in] file
+     * Path of the image pack
+     * @param[in] count
+     * Number of images that will be added
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    open(
+            const std::string &file,
+            uint64_t count);
+
+    /** @brief This function appends an image
+     *
+     * @param[in] id
+     * Identifier of the image
+     * @param[in] path
+     * Path the image was read from, or would be written to
+     * @param[in] image
+     * The image
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    add(
+            const std::string &id,
+            const std::string &path,
+            const FRPC::Image &image);
+
+    /** @brief This function writes the header and index once all
+     * images have been added
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    close();
+
+private:
+    std::string file;
+    std::ofstream stream;
+    PackHeader header;
+    std::vector<PackEntry> index;
+    uint64_t offset;
+};
+
+/** @brief This function decodes every image of an input list and writes
+ * them into an image pack
+ *
+ * @param[in] inputFile
+ * Input list of "id imagePath" lines
+ * @param[in] packFile
+ * Path of the image pack to write
+ *
+ * @return
+ * SUCCESS if successful; FAILURE otherwise
+ */
+int
+writeImagePack(
+        const std::string &inputFile,
+        const std::string &packFile);
+
+#endif /* IMAGEPACK_H_ */
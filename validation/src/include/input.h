@@ -0,0 +1,437 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef INPUT_H_
+#define INPUT_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "frpc.h"
+#include "imagepack.h"
+
+/**
+ * @brief
+ * Sequential reader over the entries of one worker's share of an input list
+ *
+ * @details
+ * Each entry has two fields: an identifier and an image path for
+ * template creation lists, or two template names for match lists.
+ */
+class InputReader {
+public:
+    virtual ~InputReader() {}
+
+    /** @brief This function reads the next entry
+     *
+     * @param[out] first
+     * The first field of the entry
+     * @param[out] second
+     * The second field of the entry
+     *
+     * @return
+     * true if an entry was read; false at the end of the input
+     */
+    virtual bool
+    next(
+            std::string &first,
+            std::string &second) = 0;
+
+    /** @brief This function reads the image of the entry most
+     * recently returned by next()
+     *
+     * @param[out] image
+     * The populated FRPC::Image
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    virtual bool
+    readImage(FRPC::Image &image) = 0;
+
+    /** @brief This function records the number of log lines written for
+     * the oldest entry returned by next() that has not yet been recorded
+     *
+     * @details Workers call this once per entry, in input order, after
+     * writing that entry's log lines.  Readers that hand out entries out
+     * of input order use it to restore the order of the logs.
+     *
+     * @param[in] lines
+     * Number of lines written to the log for the entry
+     */
+    virtual void
+    recordLogLines(uint64_t lines) {}
+};
+
+/**
+ * @brief
+ * InputReader over a range of a memory-mapped text list of
+ * whitespace-separated entries
+ *
+ * @details
+ * Fields are scanned in place and copied into the caller's strings,
+ * whose capacity is reused from one entry to the next.
+ */
+class TextReader : public InputReader {
+public:
+    /**
+     * @param[in] begin
+     * First byte of the range, which must stay mapped while the
+     * reader is in use
+     * @param[in] end
+     * One past the last byte of the range
+     */
+    TextReader(
+            const char *begin,
+            const char *end);
+
+    bool
+    next(
+            std::string &first,
+            std::string &second) override;
+
+    bool
+    readImage(FRPC::Image &image) override;
+
+private:
+    const char *current;
+    const char *end;
+    std::string imagePath;
+};
+
+/**
+ * @brief
+ * InputReader over a range of images in an image pack
+ */
+class PackReader : public InputReader {
+public:
+    /**
+     * @param[in] pack
+     * The image pack, which must outlive the reader
+     * @param[in] begin
+     * Index of the first image to read
+     * @param[in] end
+     * Index one past the last image to read
+     */
+    PackReader(
+            const ImagePack &pack,
+            uint64_t begin,
+            uint64_t end);
+
+    bool
+    next(
+            std::string &first,
+            std::string &second) override;
+
+    bool
+    readImage(FRPC::Image &image) override;
+
+private:
+    const ImagePack &pack;
+    uint64_t current;
+    uint64_t end;
+};
+
+/**
+ * @brief
+ * Header of the entry table shared by the workers of an indexed InputList
+ *
+ * @details
+ * The header is followed by one EntryRecord per entry, in processing
+ * order, then, for text lists, the offset of every entry within the
+ * mapped list, then, if the entries are processed out of list order, the
+ * list index of the entry at each processing position.  The table lives
+ * in anonymous shared memory, so forked children and threads claim chunks
+ * from the same counter and the parent sees every worker's records.
+ */
+struct QueueHeader {
+    /** Index of the next chunk to be claimed */
+    std::atomic<uint64_t> nextChunk;
+};
+
+/**
+ * @brief
+ * Record of which worker processed an entry of an indexed InputList
+ */
+struct EntryRecord {
+    /** Worker that processed the entry, or -1 if none did */
+    int32_t worker;
+    /** Number of log lines the worker wrote for the entry */
+    uint32_t logLines;
+};
+
+class IndexedReader;
+
+/**
+ * @brief
+ * A driver input list, divided into partitions for the worker processes
+ *
+ * @details
+ * The input is either a text list or an image pack named as "pack:FILE".
+ * A text list is mapped into memory once and divided into contiguous
+ * byte ranges that start and end on line boundaries; an image pack is
+ * divided into contiguous ranges of images.  Forked workers inherit the
+ * mapping, so no per-partition copies of the list are written.
+ *
+ * The list is instead indexed entry by entry when it is opened with a
+ * chunk size or grouped:
+ *  - With a chunk size, the entries are placed in a shared work queue
+ *    from which every worker claims chunkSize entries at a time until the
+ *    list is exhausted, so that fast workers are not left idle waiting
+ *    for a slow one.
+ *  - Grouped, the entries are processed in order of their second field,
+ *    then their first, so that entries sharing a field are handled by one
+ *    worker, one after the other.  Without a chunk size, partitions end
+ *    only where the second field changes.
+ *
+ * The logs of an indexed list then hold entries out of list order, and
+ * restoreLogOrder() reassembles them.
+ */
+class InputList {
+public:
+    InputList();
+
+    /** @brief This function opens an input list and divides it
+     *
+     * @param[in] inputFile
+     * Path to a text list, or "pack:" followed by the path to an image pack
+     * @param[in,out] numParts
+     * The requested number of partitions, reduced if there are
+     * fewer entries (or chunks) than partitions
+     * @param[in] chunkSize
+     * Number of entries workers claim at a time from a shared work
+     * queue, or 0 to give each worker a fixed partition
+     * @param[in] grouped
+     * Whether to process entries in order of their second field, then
+     * their first, instead of in list order
+     *
+     * @return
+     * SUCCESS if successful; FAILURE otherwise
+     */
+    int
+    open(
+            const std::string &inputFile,
+            int &numParts,
+            uint64_t chunkSize = 0,
+            bool grouped = false);
+
+    /** @brief This function returns whether the input is an image pack */
+    bool
+    isPack() const;
+
+    /** @brief This function returns whether workers claim entries from a
+     * shared work queue
+     */
+    bool
+    isDynamic() const;
+
+    /** @brief This function returns whether the logs of the workers need
+     * restoreLogOrder()
+     */
+    bool
+    isIndexed() const;
+
+    /** @brief This function returns the number of entries in the input */
+    uint64_t
+    size() const;
+
+    /** @brief This function merges the per-worker logs of an indexed list
+     * back into list order
+     *
+     * @details The merged log replaces logs[0] and the other logs are
+     * removed.  Each log must start with the same one-line header.  Does
+     * nothing if the list is not indexed.  Every entry must have been
+     * processed and every line of every log recorded against an entry,
+     * so call this only once all workers have succeeded.
+     *
+     * @param[in] logs
+     * The log written by each worker, indexed by partition
+     *
+     * @return
+     * SUCCESS if successful; FAILURE otherwise, leaving the logs untouched
+     */
+    int
+    restoreLogOrder(const std::vector<std::string> &logs) const;
+
+    /** @brief This function creates a reader over one partition
+     *
+     * @param[in] part
+     * Index of the partition
+     *
+     * @return
+     * The reader
+     */
+    std::unique_ptr<InputReader>
+    reader(int part) const;
+
+private:
+    friend class IndexedReader;
+
+    int
+    openIndexed(
+            const std::string &inputFile,
+            int &numParts,
+            uint64_t chunkSize,
+            bool grouped);
+
+    /* Reads the first and second fields of entry i of an indexed list */
+    bool
+    fields(
+            uint64_t i,
+            std::string &first,
+            std::string &second) const;
+
+    bool packInput;
+    ImagePack pack;
+    std::shared_ptr<uint8_t> listMapping;
+    size_t listLength;
+    /* Number of entries, of every kind of input */
+    uint64_t numEntries;
+    /*
+     * Image index ranges of a pack or byte ranges of a text list, or
+     * processing position ranges of an indexed list without a queue
+     */
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+
+    /* Shared entry table of an indexed list */
+    bool indexed;
+    uint64_t chunkSize;
+    uint64_t numChunks;
+    std::shared_ptr<uint8_t> queueMemory;
+    QueueHeader *queueHeader;
+    EntryRecord *records;
+    const uint64_t *entryOffsets;
+    const uint64_t *order;
+};
+
+/**
+ * @brief
+ * InputReader over the entries of an indexed InputList, either a fixed
+ * range of processing positions or chunks claimed from its work queue
+ */
+class IndexedReader : public InputReader {
+public:
+    /**
+     * @param[in] list
+     * The indexed input list, which must outlive the reader
+     * @param[in] worker
+     * Index of the worker using the reader
+     */
+    IndexedReader(
+            const InputList &list,
+            int worker);
+
+    bool
+    next(
+            std::string &first,
+            std::string &second) override;
+
+    bool
+    readImage(FRPC::Image &image) override;
+
+    void
+    recordLogLines(uint64_t lines) override;
+
+private:
+    const InputList &list;
+    int worker;
+    uint64_t current;
+    uint64_t end;
+    uint64_t entry;
+    std::string imagePath;
+    /* Processing positions returned by next() but not yet recorded */
+    std::deque<uint64_t> unrecorded;
+};
+
+/**
+ * @brief
+ * InputReader that reads and decodes upcoming images on a background
+ * thread while the worker processes the current one
+ *
+ * @details
+ * Entries are read ahead of the worker into a ring of depth reusable
+ * slots.  The background thread waits while the ring is full, so at most
+ * depth decoded images are held at once.  Images are mapped rather than
+ * copied, so the thread also touches every page of each image, bringing
+ * it in from storage before the worker needs it.  Only for lists of
+ * images to create templates from.
+ */
+class PrefetchReader : public InputReader {
+public:
+    /**
+     * @param[in] reader
+     * The reader to read ahead of
+     * @param[in] depth
+     * Number of entries to read ahead, at least 1
+     */
+    PrefetchReader(
+            std::unique_ptr<InputReader> reader,
+            size_t depth);
+
+    ~PrefetchReader();
+
+    bool
+    next(
+            std::string &first,
+            std::string &second) override;
+
+    bool
+    readImage(FRPC::Image &image) override;
+
+    void
+    recordLogLines(uint64_t lines) override;
+
+private:
+    struct Slot {
+        std::string first;
+        std::string second;
+        FRPC::Image image;
+        bool imageRead;
+    };
+
+    /* Body of the background thread */
+    void
+    readAhead();
+
+    std::unique_ptr<InputReader> reader;
+    /* Serializes the background thread's next() and the worker's recordLogLines() */
+    std::mutex readerMutex;
+
+    std::vector<Slot> ring;
+    /* Slot the worker reads next, and number of filled slots from there */
+    size_t head;
+    size_t count;
+    bool finished;
+    bool stopping;
+    std::mutex ringMutex;
+    std::condition_variable filled;
+    std::condition_variable emptied;
+
+    /* Entry most recently returned by next() */
+    FRPC::Image image;
+    bool imageRead;
+
+    std::thread thread;
+};
+
+/** @brief This function returns whether a driver input file argument
+ * names an image pack
+ */
+bool
+isPackInput(const std::string &inputFile);
+
+#endif /* INPUT_H_ */
@@ -0,0 +1,166 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief
+ * Interface methods whose calls are timed
+ */
+enum class TimedCall {
+    Initialize,
+    InitializeEnrollmentSession,
+    InitializeProbeTemplateSession,
+    InitializeIdentificationSession,
+    CreateTemplates,
+    MatchTemplatesBatch,
+    IdentifyTemplates,
+    FinalizeEnrollment
+};
+
+/** Number of TimedCall values */
+const size_t NumTimedCalls = 8;
+
+/** @brief This function returns the name of the interface method
+ * of a TimedCall */
+const char*
+to_string(TimedCall call);
+
+/** @brief This function returns the time of the monotonic clock, which
+ * is the same in every process, in nanoseconds */
+uint64_t
+monotonicNs();
+
+/*
+ * Latencies are counted in log-linear buckets: values below
+ * LatencySubBuckets nanoseconds have a bucket each, and every power of
+ * two above that is split into LatencySubBuckets equal buckets, so a
+ * bucket is never wider than 1/LatencySubBuckets of the values in it.
+ */
+
+/** Buckets per power of two */
+const uint64_t LatencySubBuckets = 32;
+/** log2(LatencySubBuckets) */
+const unsigned LatencySubBucketBits = 5;
+/** Buckets covering every uint64_t value */
+const size_t LatencyBuckets = (64 - LatencySubBucketBits + 1) * LatencySubBuckets;
+
+/**
+ * @brief
+ * Histogram of the latencies of one interface method
+ *
+ * @details
+ * Plain data that starts out zero-filled, so that histograms can be
+ * placed in memory from mapShared() and filled in by forked workers.
+ */
+struct LatencyHistogram {
+    /** Number of calls */
+    uint64_t calls;
+    /** Number of items (images, comparisons or probes) passed */
+    uint64_t items;
+    uint64_t totalNs;
+    uint64_t minNs;
+    uint64_t maxNs;
+    /** Start of the first call and end of the last */
+    uint64_t firstStartNs;
+    uint64_t lastEndNs;
+    uint64_t buckets[LatencyBuckets];
+
+    /** @brief This function records one call
+     *
+     * @param[in] startNs
+     * monotonicNs() before the call
+     * @param[in] endNs
+     * monotonicNs() after the call
+     * @param[in] numItems
+     * Number of items passed to the call
+     */
+    void
+    record(
+            uint64_t startNs,
+            uint64_t endNs,
+            uint64_t numItems);
+
+    /** @brief This function adds the calls of another histogram */
+    void
+    merge(const LatencyHistogram &other);
+
+    /** @brief This function returns the latency, in nanoseconds, that
+     * the given fraction of calls did not exceed */
+    uint64_t
+    percentile(double fraction) const;
+};
+
+/**
+ * @brief
+ * The histograms of one worker, one per TimedCall
+ */
+struct WorkerLatency {
+    LatencyHistogram calls[NumTimedCalls];
+
+    LatencyHistogram&
+    operator[](TimedCall call)
+    {
+        return (this->calls[static_cast<size_t>(call)]);
+    }
+};
+
+/**
+ * @brief
+ * Latency histograms of every worker of a driver, in shared memory
+ *
+ * @details
+ * Created by the parent before workers are started.  Each worker
+ * records into its own WorkerLatency, so no locking is needed; calls
+ * made by the parent before then are recorded into worker 0's.
+ */
+class LatencyRecorder {
+public:
+    LatencyRecorder();
+
+    /** @brief This function maps zero-filled histograms for numWorkers
+     * workers
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    create(int numWorkers);
+
+    /** @brief This function returns the histograms of worker i */
+    WorkerLatency&
+    worker(int i);
+
+    /** @brief This function merges the histograms of every worker and
+     * writes one line per timed method with calls, items, percentiles
+     * and maximum in microseconds, and items per second between the
+     * start of the first call and the end of the last
+     *
+     * @param[in] file
+     * Path of the summary
+     *
+     * @return
+     * SUCCESS if successful; FAILURE otherwise
+     */
+    int
+    writeSummary(const std::string &file) const;
+
+private:
+    int numWorkers;
+    std::shared_ptr<uint8_t> memory;
+    WorkerLatency *workers;
+};
+
+#endif /* LATENCY_H_ */
@@ -0,0 +1,64 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef MERGE_H_
+#define MERGE_H_
+
+#include <string>
+
+/*
+ * Shards are the files written by the workers of a driver, named after
+ * the merged file with the suffixes .0, .1, ... up to the first missing
+ * number.  Shard i holds the output for partition i of the input, so
+ * joining the shards in numeric order puts the output in input order.
+ */
+
+/** @brief This function returns the name of shard i of a merged file */
+std::string
+shardFile(
+        const std::string &name,
+        int shard);
+
+/** @brief This function returns the number of shards of a merged file
+ * before the first missing number */
+int
+countShards(const std::string &name);
+
+/** @brief This function merges the logs log.0, log.1, ... into log
+ *
+ * @details Every shard starts with the same header line, which is
+ * written once.  The shards are removed once merged.
+ *
+ * @param[in] log
+ * Path of the merged log
+ *
+ * @return
+ * SUCCESS if successful; FAILURE otherwise
+ */
+int
+mergeLogs(const std::string &log);
+
+/** @brief This function merges EDB shards edb.0, edb.1, ... and their
+ * manifests manifest.0, manifest.1, ... into edb and manifest
+ *
+ * @details Each shard's manifest offsets are relative to its own EDB
+ * shard; they are rebased onto the merged EDB.  The shards are removed
+ * once merged.
+ *
+ * @param[in] edbDir
+ * Directory holding the shards
+ *
+ * @return
+ * SUCCESS if successful; FAILURE otherwise
+ */
+int
+mergeEDBShards(const std::string &edbDir);
+
+#endif /* MERGE_H_ */
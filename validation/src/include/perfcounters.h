@@ -0,0 +1,252 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef PERFCOUNTERS_H_
+#define PERFCOUNTERS_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "latency.h"
+#include "progress.h"
+
+/**
+ * @brief
+ * Hardware events counted around interface calls
+ */
+enum class Counter {
+    Cycles,
+    Instructions,
+    /** Last-level cache read misses */
+    LLCMisses,
+    BranchMisses,
+    /** Data TLB read misses */
+    DTLBMisses
+};
+
+/** Number of Counter values */
+const size_t NumCounters = 5;
+
+/** @brief This function returns the name of a Counter */
+const char*
+to_string(Counter counter);
+
+/**
+ * @brief
+ * Values of the counters at one point in time
+ */
+struct CounterReading {
+    uint64_t values[NumCounters];
+    /** Nanoseconds the counters were enabled and actually counting,
+     * which differ when the kernel multiplexes counters */
+    uint64_t enabledNs;
+    uint64_t runningNs;
+};
+
+/**
+ * @brief
+ * The hardware counters of the calling thread
+ *
+ * @details
+ * Counters are opened with perf_event_open(2) as one group, so that
+ * they are read together, and count user-space events only.  Counters
+ * the processor, kernel or its perf_event_paranoid setting do not
+ * allow are left out.
+ */
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    /** @brief This function opens every available counter for the
+     * calling thread
+     *
+     * @return
+     * true if at least one counter could be opened; false otherwise,
+     * with the reason in error()
+     */
+    bool
+    open();
+
+    /** @brief This function returns a bit (1 << Counter) for each
+     * counter that is open */
+    uint32_t
+    available() const;
+
+    /** @brief This function returns why the first counter that could
+     * not be opened failed, or an empty string */
+    const std::string&
+    error() const;
+
+    /** @brief This function reads the open counters
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    read(CounterReading &reading) const;
+
+private:
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters &operator=(const PerfCounters&) = delete;
+
+    int fds[NumCounters];
+    /* Position of each counter in a group read, or -1 if not open */
+    int positions[NumCounters];
+    int numOpen;
+    std::string reason;
+};
+
+/**
+ * @brief
+ * Counter totals over every call of one interface method
+ */
+struct CounterTotals {
+    uint64_t calls;
+    /** Totals, scaled up for the time counters were not running */
+    uint64_t values[NumCounters];
+};
+
+/**
+ * @brief
+ * The counter totals of one worker, one per TimedCall
+ *
+ * @details
+ * Plain data that starts out zero-filled, like WorkerLatency.
+ */
+struct WorkerCounters {
+    /** available() of the worker's counters */
+    uint32_t available;
+    CounterTotals calls[NumTimedCalls];
+
+    CounterTotals&
+    operator[](TimedCall call)
+    {
+        return (this->calls[static_cast<size_t>(call)]);
+    }
+};
+
+/**
+ * @brief
+ * Counter totals of every worker of a driver, in shared memory
+ *
+ * @details
+ * Counting is opt-in: until create() is called, worker() returns
+ * nullptr and nothing is counted.
+ */
+class CounterRecorder {
+public:
+    CounterRecorder();
+
+    /** @brief This function maps zero-filled totals for numWorkers
+     * workers, and warns if hardware counters are unavailable
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    create(int numWorkers);
+
+    /** @brief This function returns the totals of worker i, or nullptr
+     * if counting is off */
+    WorkerCounters*
+    worker(int i);
+
+    /** @brief This function merges the totals of every worker and
+     * writes one line per timed method with calls, counter totals,
+     * instructions per cycle and misses per call; counters no worker
+     * could open are written as -
+     *
+     * @param[in] file
+     * Path of the report
+     *
+     * @return
+     * SUCCESS if successful; FAILURE otherwise
+     */
+    int
+    writeReport(const std::string &file) const;
+
+private:
+    int numWorkers;
+    std::shared_ptr<uint8_t> memory;
+    WorkerCounters *workers;
+};
+
+/**
+ * @brief
+ * Measures the interface calls of one worker
+ *
+ * @details
+ * Each call is timed into the worker's latency histograms and its
+ * progress and, if counting is on, its counters are read before and
+ * after the call and the difference added to the worker's totals.
+ * Counters count the thread that constructs the CallMeter, which must
+ * make the calls.
+ */
+class CallMeter {
+public:
+    /** @brief Constructor
+     *
+     * @param[in] latency
+     * The worker's latency histograms
+     * @param[in] counters
+     * The worker's counter totals, or nullptr to count nothing
+     * @param[in] progress
+     * The worker's progress, or nullptr if the calls are not the
+     * worker's items
+     */
+    CallMeter(
+            WorkerLatency &latency,
+            WorkerCounters *counters,
+            WorkerProgress *progress = nullptr);
+
+    /** @brief This function is called right before an interface call */
+    void
+    begin();
+
+    /** @brief This function is called right after an interface call
+     *
+     * @param[in] call
+     * The method called
+     * @param[in] numItems
+     * Number of items passed to the call
+     */
+    void
+    end(
+            TimedCall call,
+            uint64_t numItems);
+
+    /** @brief This function adds items the worker finished to its
+     * progress
+     *
+     * @param[in] numItems
+     * Number of items finished
+     * @param[in] numFailures
+     * Number of those whose interface call did not return success
+     * @param[in] numBytes
+     * Bytes of output written for them
+     */
+    void
+    finished(
+            uint64_t numItems,
+            uint64_t numFailures,
+            uint64_t numBytes);
+
+private:
+    WorkerLatency &latency;
+    WorkerCounters *counters;
+    WorkerProgress *progress;
+    PerfCounters perf;
+    CounterReading before;
+    uint64_t startNs;
+};
+
+#endif /* PERFCOUNTERS_H_ */
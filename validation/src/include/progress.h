@@ -0,0 +1,114 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef PROGRESS_H_
+#define PROGRESS_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief
+ * Running totals of one worker, updated as it goes
+ *
+ * @details
+ * Lives in memory from mapShared() so that the parent can read the
+ * totals of forked workers while they run.  Each worker only adds to
+ * its own totals, so updates need no lock.
+ */
+struct WorkerProgress {
+    /** Items (images, comparisons or probes) finished */
+    std::atomic<uint64_t> items;
+    /** Items whose interface call did not return success */
+    std::atomic<uint64_t> failures;
+    /** Bytes of templates, or of the score matrix, written */
+    std::atomic<uint64_t> bytes;
+    /** Nanoseconds spent in interface calls */
+    std::atomic<uint64_t> callNs;
+    /** Nonzero once the worker has finished */
+    std::atomic<uint32_t> finished;
+};
+
+/**
+ * @brief
+ * Progress of every worker of a driver, in shared memory, and an
+ * optional thread in the parent that reports it while workers run
+ */
+class ProgressRecorder {
+public:
+    ProgressRecorder();
+    ~ProgressRecorder();
+
+    /** @brief This function maps zero totals for numWorkers workers;
+     * throughput is measured from here
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    create(int numWorkers);
+
+    /** @brief This function returns the totals of worker i */
+    WorkerProgress*
+    worker(int i);
+
+    /** @brief This function starts writing a report() line to stderr
+     * every intervalSeconds, until stopReports()
+     *
+     * @param[in] intervalSeconds
+     * Seconds between reports
+     * @param[in] totalItems
+     * Number of items the workers will finish, or 0 if unknown
+     */
+    void
+    startReports(
+            int intervalSeconds,
+            uint64_t totalItems);
+
+    /** @brief This function stops the reports, if started, after a
+     * final one */
+    void
+    stopReports();
+
+    /** @brief This function returns one line with items finished,
+     * items per second overall and since the previous report, time
+     * remaining, failures, bytes written, the share of worker time spent
+     * in interface calls, and the spread of items over the workers,
+     * naming workers that made no progress since the previous report */
+    std::string
+    report();
+
+private:
+    ProgressRecorder(const ProgressRecorder&) = delete;
+    ProgressRecorder &operator=(const ProgressRecorder&) = delete;
+
+    int numWorkers;
+    uint64_t startNs;
+    uint64_t totalItems;
+    std::shared_ptr<uint8_t> memory;
+    WorkerProgress *workers;
+
+    /* Totals at the previous report */
+    uint64_t lastNs;
+    std::vector<uint64_t> lastItems;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable stopped;
+    bool stopping;
+};
+
+#endif /* PROGRESS_H_ */
@@ -0,0 +1,150 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef RESOURCES_H_
+#define RESOURCES_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/** Whose resource usage a sample measures */
+enum class ResourceScope {
+    /** The calling process */
+    Process,
+    /** The calling thread; memory is still that of the process */
+    Thread,
+    /** The children of the calling process that have been waited for;
+     * memory is not sampled */
+    Children
+};
+
+/**
+ * @brief
+ * Resource usage at the end of a phase of a driver
+ *
+ * @details
+ * Times and counts are cumulative from the start of the process (or
+ * thread), as returned by getrusage(2).  Memory is from
+ * /proc/self/smaps_rollup, or the sum of /proc/self/smaps where that is
+ * missing, and is -1 where neither could be read.
+ */
+struct ResourceSample {
+    /** NUL-terminated name of the phase */
+    char phase[24];
+    /** Worker index, or -1 for the parent */
+    int32_t worker;
+    int32_t pid;
+    /** Nanoseconds since the recorder was created */
+    uint64_t elapsedNs;
+
+    uint64_t userUs;
+    uint64_t systemUs;
+    uint64_t maxRssKiB;
+    uint64_t minorFaults;
+    uint64_t majorFaults;
+    uint64_t voluntarySwitches;
+    uint64_t involuntarySwitches;
+
+    int64_t rssKiB;
+    int64_t pssKiB;
+    int64_t sharedCleanKiB;
+    int64_t sharedDirtyKiB;
+    int64_t privateCleanKiB;
+    int64_t privateDirtyKiB;
+    int64_t swapKiB;
+};
+
+/** Maximum number of samples kept for the parent and for each worker */
+const uint32_t ResourceSamplesPerWorker = 8;
+
+/**
+ * @brief
+ * Resource samples of the parent and every worker of a driver, in
+ * shared memory
+ *
+ * @details
+ * Created by the parent before workers are started.  The parent and
+ * each worker record into their own samples, so no locking is needed.
+ */
+class ResourceRecorder {
+public:
+    ResourceRecorder();
+
+    /** @brief This function maps space for the samples of the parent
+     * and numWorkers workers
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    create(int numWorkers);
+
+    /** @brief This function samples the resource usage of the caller
+     *
+     * @details Samples beyond ResourceSamplesPerWorker are dropped.
+     *
+     * @param[in] worker
+     * Index of the calling worker, or -1 for the parent
+     * @param[in] phase
+     * Name of the phase that just ended
+     * @param[in] scope
+     * Whose usage to sample
+     */
+    void
+    sample(
+            int worker,
+            const char *phase,
+            ResourceScope scope);
+
+    /** @brief This function finds the first sample of a phase
+     *
+     * @param[in] worker
+     * Index of the worker that took the sample, or -1 for the parent
+     * @param[in] phase
+     * Name of the phase
+     * @param[out] sample
+     * The sample
+     *
+     * @return
+     * true if the sample was found; false otherwise
+     */
+    bool
+    find(
+            int worker,
+            const std::string &phase,
+            ResourceSample &sample) const;
+
+    /** @brief This function writes every sample, the parent's first,
+     * one line per sample
+     *
+     * @param[in] file
+     * Path of the report
+     *
+     * @return
+     * SUCCESS if successful; FAILURE otherwise
+     */
+    int
+    writeReport(const std::string &file) const;
+
+private:
+    /* The samples of the parent or of one worker */
+    struct Samples {
+        uint32_t count;
+        ResourceSample samples[ResourceSamplesPerWorker];
+    };
+
+    int numWorkers;
+    uint64_t startNs;
+    std::shared_ptr<uint8_t> memory;
+    Samples *owners;
+};
+
+#endif /* RESOURCES_H_ */
@@ -0,0 +1,153 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef SCOREMATRIX_H_
+#define SCOREMATRIX_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frpc.h"
+
+/*
+ * A score matrix file holds the similarity scores of every verification
+ * template (row) against every enrollment template (column): a
+ * ScoreMatrixHeader, then rows * cols doubles in row-major order, then
+ * rows * cols one-byte return codes in the same order, then the names of
+ * the row templates and of the column templates, one per line.  Row i
+ * and column j are the i-th and j-th entries of the verification and
+ * enrollment lists.  Integers and doubles are stored in host byte order.
+ */
+
+/** Magic number at the start of every score matrix */
+const char ScoreMatrixMagic[8] = {'F', 'R', 'P', 'C', 'M', 'T', 'R', 'X'};
+/** Version of the score matrix layout */
+const uint32_t ScoreMatrixVersion = 1;
+/** Return code of a cell whose comparison was never made */
+const uint8_t ScoreMatrixNotComputed = 0xFF;
+
+/**
+ * @brief
+ * Header at the start of a score matrix
+ */
+struct ScoreMatrixHeader {
+    /** ScoreMatrixMagic */
+    char magic[8];
+    /** ScoreMatrixVersion */
+    uint32_t version;
+    uint32_t reserved0;
+    /** Number of verification templates */
+    uint64_t rows;
+    /** Number of enrollment templates */
+    uint64_t cols;
+    /** Offset of the first score */
+    uint64_t scoresOffset;
+    /** Offset of the first return code */
+    uint64_t codesOffset;
+    /** Offset of the template names, which run to the end of the file */
+    uint64_t namesOffset;
+    uint8_t reserved[8];
+};
+
+static_assert(sizeof(ScoreMatrixHeader) == 64,
+        "ScoreMatrixHeader must be 64 bytes");
+
+/**
+ * @brief
+ * Memory-mapped score matrix file
+ *
+ * @details
+ * A matrix created before forking is shared with the children, which
+ * write their cells straight into the file.
+ */
+class ScoreMatrix {
+public:
+    ScoreMatrix();
+
+    /** @brief This function creates a matrix file with every cell
+     * marked as not computed, and maps it for writing
+     *
+     * @param[in] file
+     * Path of the matrix file
+     * @param[in] rowNames
+     * Names of the verification templates
+     * @param[in] colNames
+     * Names of the enrollment templates
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    create(
+            const std::string &file,
+            const std::vector<std::string> &rowNames,
+            const std::vector<std::string> &colNames);
+
+    /** @brief This function maps an existing matrix file for reading
+     *
+     * @param[in] file
+     * Path of the matrix file
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    open(const std::string &file);
+
+    /** @brief This function returns the number of rows */
+    uint64_t
+    rows() const;
+
+    /** @brief This function returns the number of columns */
+    uint64_t
+    cols() const;
+
+    /** @brief This function returns the name of the template of a row */
+    const std::string&
+    rowName(uint64_t row) const;
+
+    /** @brief This function returns the name of the template of a column */
+    const std::string&
+    colName(uint64_t col) const;
+
+    /** @brief This function stores the result of one comparison */
+    void
+    set(
+            uint64_t row,
+            uint64_t col,
+            double score,
+            FRPC::ReturnCode code);
+
+    /** @brief This function returns the score of one comparison */
+    double
+    score(
+            uint64_t row,
+            uint64_t col) const;
+
+    /** @brief This function returns the return code of one comparison,
+     * or ScoreMatrixNotComputed */
+    uint8_t
+    code(
+            uint64_t row,
+            uint64_t col) const;
+
+private:
+    std::shared_ptr<uint8_t> mapping;
+    size_t length;
+    const ScoreMatrixHeader *header;
+    double *scores;
+    uint8_t *codes;
+    std::vector<std::string> rowNames;
+    std::vector<std::string> colNames;
+};
+
+#endif /* SCOREMATRIX_H_ */
@@ -0,0 +1,223 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef SHAREDEDB_H_
+#define SHAREDEDB_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief
+ * Enrollment database and manifest written concurrently by every
+ * enrollment worker
+ *
+ * @details
+ * The files and the end-of-EDB and end-of-manifest offsets are set up by
+ * the parent before workers are started.  Workers reserve a range of each
+ * file by advancing its shared offset and write their templates and the
+ * matching manifest lines into those ranges with pwrite(2).  No two
+ * workers write the same bytes, so the files need neither locks nor
+ * atomic appends, which NFS does not provide.  The result is the EDB and
+ * manifest passed to finalizeEnrollment(), with no merge step; manifest
+ * lines follow the order in which workers reserved them.  Workers
+ * normally write through an EDBWriter each, which batches their
+ * templates and writes them from a background thread.
+ */
+class SharedEDB {
+public:
+    SharedEDB();
+    ~SharedEDB();
+
+    /** @brief This function creates an empty EDB and manifest
+     *
+     * @param[in] edb
+     * Path of the EDB file
+     * @param[in] manifest
+     * Path of the manifest file
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    create(
+            const std::string &edb,
+            const std::string &manifest);
+
+    /** @brief This function adds templates to the EDB and manifest
+     *
+     * @details Safe to call from several threads or forked processes
+     * at once.
+     *
+     * @param[in] ids
+     * Template IDs
+     * @param[in] templs
+     * Templates, one per ID; empty templates get a manifest line too
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    add(
+            const std::vector<std::string> &ids,
+            const std::vector<std::vector<uint8_t>> &templs);
+
+    /** @brief This function reserves a range of the EDB
+     *
+     * @param[in] length
+     * Number of bytes to reserve
+     *
+     * @return
+     * Offset of the range
+     */
+    uint64_t
+    reserveEDB(uint64_t length);
+
+    /** @brief This function reserves a range of the manifest
+     *
+     * @param[in] length
+     * Number of bytes to reserve
+     *
+     * @return
+     * Offset of the range
+     */
+    uint64_t
+    reserveManifest(uint64_t length);
+
+    /** @brief This function writes templates into a reserved range of
+     * the EDB
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    writeEDB(
+            const uint8_t *data,
+            size_t length,
+            uint64_t offset);
+
+    /** @brief This function writes manifest lines into a reserved range
+     * of the manifest
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    writeManifest(
+            const std::string &lines,
+            uint64_t offset);
+
+private:
+    SharedEDB(const SharedEDB&) = delete;
+    SharedEDB &operator=(const SharedEDB&) = delete;
+
+    std::string edbFile;
+    int edbFd;
+    int manifestFd;
+    std::shared_ptr<uint8_t> counterMemory;
+    std::atomic<uint64_t> *nextOffset;
+    std::atomic<uint64_t> *nextManifestOffset;
+};
+
+/** Bytes of templates an EDBWriter collects before writing them */
+const size_t EDBWriterBufferSize = 1 << 20;
+/** Number of templates an EDBWriter collects, at most, before writing them */
+const size_t EDBWriterMaxTemplates = 1 << 14;
+/** Number of batches of an EDBWriter */
+const size_t EDBWriterBatches = 4;
+
+/**
+ * @brief
+ * One worker's writer of templates to a SharedEDB, from a background
+ * thread
+ *
+ * @details
+ * Templates are collected into batches of about EDBWriterBufferSize
+ * bytes.  When a batch is full, the worker reserves ranges of the EDB
+ * and manifest for it and hands it to a background thread, which writes
+ * it with one pwrite(2) to each file.  The worker only waits when every
+ * batch is waiting to be written.  The EDB and manifest are complete
+ * once close() returns.
+ */
+class EDBWriter {
+public:
+    /** @brief This function starts a writer to edb, which must outlive it */
+    EDBWriter(SharedEDB &edb);
+    ~EDBWriter();
+
+    /** @brief This function adds templates to the current batch, and
+     * hands the batch over once it is full
+     *
+     * @param[in] ids
+     * Template IDs
+     * @param[in] templs
+     * Templates, one per ID; empty templates get a manifest line too
+     *
+     * @return
+     * false if an earlier batch could not be written; true otherwise
+     */
+    bool
+    add(
+            const std::vector<std::string> &ids,
+            const std::vector<std::vector<uint8_t>> &templs);
+
+    /** @brief This function writes every batch and stops the thread
+     *
+     * @return
+     * true if every write succeeded; false otherwise
+     */
+    bool
+    close();
+
+private:
+    EDBWriter(const EDBWriter&) = delete;
+    EDBWriter &operator=(const EDBWriter&) = delete;
+
+    /* Templates, and where they go, of one batch */
+    struct Batch {
+        std::vector<uint8_t> templates;
+        std::vector<std::string> ids;
+        std::vector<uint64_t> sizes;
+        std::string lines;
+        uint64_t edbOffset;
+        uint64_t manifestOffset;
+    };
+
+    /* Reserves ranges for the current batch, queues it, and waits for a
+     * free batch */
+    void
+    handOff();
+
+    /* Body of the background thread */
+    void
+    writeBehind();
+
+    SharedEDB &edb;
+    std::vector<Batch> batches;
+    size_t current;
+    std::deque<size_t> freeBatches;
+    std::deque<size_t> fullBatches;
+    bool stopping;
+    bool failed;
+    std::mutex mutex;
+    std::condition_variable queued;
+    std::condition_variable released;
+    std::thread thread;
+};
+
+#endif /* SHAREDEDB_H_ */
@@ -0,0 +1,106 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef TEMPLATEARENA_H_
+#define TEMPLATEARENA_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "frpc.h"
+#include "templatestore.h"
+
+/** Alignment, in bytes, of every template within a TemplateArena */
+const uint64_t TemplateArenaAlignment = 64;
+
+/**
+ * @brief
+ * Templates referenced by a match list, preloaded into one contiguous
+ * block of memory
+ *
+ * @details
+ * The arena is loaded by the parent before workers are started and is
+ * only read afterwards, so forked workers and threads share its pages.
+ * Each template starts on a TemplateArenaAlignment-byte boundary.
+ */
+class TemplateArena {
+public:
+    TemplateArena();
+
+    /** @brief This function loads templates by name
+     *
+     * @details Templates are laid out in the order they first appear in
+     * keys; repeated names are loaded once.
+     *
+     * @param[in] keys
+     * Names of the templates
+     * @param[in] templatesDir
+     * The templates directory
+     * @param[in] store
+     * The template store of templatesDir, or nullptr to read one file
+     * per template
+     *
+     * @return
+     * SUCCESS if successful; FAILURE otherwise
+     */
+    int
+    load(
+            const std::vector<std::string> &keys,
+            const std::string &templatesDir,
+            const TemplateStore *store);
+
+    /** @brief This function loads every template named in a match list
+     *
+     * @param[in] matchList
+     * Path to a list of "enrollTemplate verifTemplate" pairs
+     * @param[in] templatesDir
+     * The templates directory
+     * @param[in] store
+     * The template store of templatesDir, or nullptr to read one file
+     * per template
+     *
+     * @return
+     * SUCCESS if successful; FAILURE otherwise
+     */
+    int
+    loadMatchList(
+            const std::string &matchList,
+            const std::string &templatesDir,
+            const TemplateStore *store);
+
+    /** @brief This function looks up a template by name
+     *
+     * @param[in] key
+     * Name of the template in the match list
+     * @param[out] view
+     * View of the template in the arena
+     *
+     * @return
+     * true if the template is in the arena; false otherwise
+     */
+    bool
+    find(
+            const std::string &key,
+            FRPC::TemplateView &view) const;
+
+    /** @brief This function returns the size of the arena in bytes */
+    size_t
+    size() const;
+
+private:
+    std::shared_ptr<uint8_t> memory;
+    size_t length;
+    std::unordered_map<std::string, FRPC::TemplateView> index;
+};
+
+#endif /* TEMPLATEARENA_H_ */
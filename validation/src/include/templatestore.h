@@ -0,0 +1,213 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef TEMPLATESTORE_H_
+#define TEMPLATESTORE_H_
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * A template store holds many 1:1 templates in two files: a data file of
+ * concatenated templates, and an index made of a TemplateIndexHeader,
+ * TemplateIndexHeader::count TemplateIndexEntry records, then
+ * TemplateIndexHeader::numSlots 64-bit hash slots.  Each slot is empty (0)
+ * or holds one plus the index of an entry, placed by linear probing from
+ * the FNV-1a hash of the entry's key.  Integers are stored in host byte
+ * order.
+ *
+ * Workers each write a shard (a data file and an index with no slots),
+ * which mergeTemplateStore() folds into the store of a templates directory.
+ */
+
+/** Magic number at the start of every template store index */
+const char TemplateIndexMagic[8] = {'F', 'R', 'P', 'C', 'T', 'I', 'D', 'X'};
+/** Version of the template store layout */
+const uint32_t TemplateIndexVersion = 1;
+/** Name of the data file of the store in a templates directory */
+const char TemplateStoreData[] = "templates.data";
+/** Name of the index of the store in a templates directory */
+const char TemplateStoreIndex[] = "templates.index";
+
+/**
+ * @brief
+ * Header at the start of a template store index
+ */
+struct TemplateIndexHeader {
+    /** TemplateIndexMagic */
+    char magic[8];
+    /** TemplateIndexVersion */
+    uint32_t version;
+    /** sizeof(TemplateIndexEntry) */
+    uint32_t entrySize;
+    /** Number of entries */
+    uint64_t count;
+    /** Number of hash slots, a power of two, or 0 for a shard */
+    uint64_t numSlots;
+    /** Size of the data file in bytes */
+    uint64_t dataSize;
+    uint8_t reserved[24];
+};
+
+/**
+ * @brief
+ * Index record locating one template in the data file
+ */
+struct TemplateIndexEntry {
+    /** NUL-terminated key, the name the template file would have had */
+    char key[112];
+    /** Offset of the template from the start of the data file */
+    uint64_t offset;
+    /** Size of the template in bytes */
+    uint64_t size;
+};
+
+static_assert(sizeof(TemplateIndexHeader) == 64,
+        "TemplateIndexHeader must be 64 bytes");
+static_assert(sizeof(TemplateIndexEntry) == 128,
+        "TemplateIndexEntry must be 128 bytes");
+
+/**
+ * @brief
+ * Writer of one worker's shard of a template store
+ */
+class TemplateStoreWriter {
+public:
+    TemplateStoreWriter();
+
+    /** @brief This function creates the files of a shard
+     *
+     * @param[in] templatesDir
+     * The templates directory
+     * @param[in] shard
+     * Index of the shard, normally the worker's partition
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    open(
+            const std::string &templatesDir,
+            int shard);
+
+    /** @brief This function appends a template to the shard
+     *
+     * @param[in] key
+     * Key used to look the template up
+     * @param[in] templ
+     * The template
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    add(
+            const std::string &key,
+            const std::vector<uint8_t> &templ);
+
+    /** @brief This function writes the shard's index and closes it
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    close();
+
+private:
+    std::string indexFile;
+    std::ofstream dataStream;
+    std::vector<TemplateIndexEntry> entries;
+    uint64_t dataSize;
+};
+
+/**
+ * @brief
+ * Read-only, memory-mapped template store
+ */
+class TemplateStore {
+public:
+    TemplateStore();
+
+    /** @brief This function maps the store of a templates directory and
+     * validates its index
+     *
+     * @param[in] templatesDir
+     * The templates directory
+     *
+     * @return
+     * true if successful; false otherwise
+     */
+    bool
+    open(const std::string &templatesDir);
+
+    /** @brief This function looks up a template by key
+     *
+     * @param[in] key
+     * The key the template was stored under
+     *
+     * @return
+     * The template's index entry, or nullptr if there is none
+     */
+    const TemplateIndexEntry*
+    find(const std::string &key) const;
+
+    /** @brief This function returns a pointer to the bytes of a template */
+    const uint8_t*
+    data(const TemplateIndexEntry &entry) const;
+
+    /** @brief This function copies a template out of the store
+     *
+     * @param[in] key
+     * The key the template was stored under
+     * @param[out] templ
+     * The template
+     *
+     * @return
+     * true if the template was found; false otherwise
+     */
+    bool
+    read(
+            const std::string &key,
+            std::vector<uint8_t> &templ) const;
+
+private:
+    std::shared_ptr<uint8_t> indexMapping;
+    std::shared_ptr<uint8_t> dataMapping;
+    size_t indexLength;
+    size_t dataLength;
+    const TemplateIndexHeader *header;
+    const TemplateIndexEntry *entries;
+    const uint64_t *slots;
+};
+
+/** @brief This function merges the shards written by workers into the
+ * store of a templates directory
+ *
+ * @details Templates are appended to an existing store, so enrollment
+ * and verification templates can share one.  A key stored again replaces
+ * the earlier template.  Merged shards are removed.
+ *
+ * @param[in] templatesDir
+ * The templates directory
+ * @param[in] numShards
+ * Number of shards, numbered from 0
+ *
+ * @return
+ * SUCCESS if successful; FAILURE otherwise
+ */
+int
+mergeTemplateStore(
+        const std::string &templatesDir,
+        int numShards);
+
+#endif /* TEMPLATESTORE_H_ */
@@ -0,0 +1,116 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <cstdint>
+#include <string>
+
+/*
+ * A timeline of what every thread of a driver and its forked workers
+ * was doing, in the Trace Event Format read by chrome://tracing and
+ * Perfetto.  Each thread records its events into a buffer of its own,
+ * so recording takes no lock.  A forked worker writes its events to a
+ * shard of the trace when it finishes, named as in merge.h, and the
+ * parent joins the shards and its own events into one JSON array, with
+ * one track per process and thread.
+ *
+ * Until traceStart() is called, nothing is recorded.
+ */
+
+/** @brief This function turns tracing on for the calling process and
+ * the processes and threads it starts
+ *
+ * @param[in] file
+ * Path of the trace, written by traceFinish()
+ */
+void
+traceStart(const std::string &file);
+
+/** @brief This function returns whether tracing is on */
+bool
+tracing();
+
+/** @brief This function names the calling thread's track */
+void
+traceThread(const std::string &name);
+
+/** @brief This function records an event on the calling thread's track
+ *
+ * @param[in] name
+ * Name of the event, which must stay valid until the trace is written
+ * @param[in] beginNs
+ * monotonicNs() at the start of the event
+ * @param[in] endNs
+ * monotonicNs() at the end of the event
+ * @param[in] items
+ * Number of items (images, comparisons, bytes) the event handled
+ */
+void
+traceEvent(
+        const char *name,
+        uint64_t beginNs,
+        uint64_t endNs,
+        uint64_t items);
+
+/**
+ * @brief
+ * Records an event from construction to destruction
+ */
+class TraceSpan {
+public:
+    /** @brief Constructor; name must stay valid until the trace is written */
+    explicit TraceSpan(const char *name);
+    ~TraceSpan();
+
+    /** @brief This function sets the number of items the event handled */
+    void
+    setItems(uint64_t items);
+
+private:
+    const char *name;
+    uint64_t beginNs;
+    uint64_t items;
+};
+
+/** @brief This function writes the events of a forked worker to
+ * shard i of the trace
+ *
+ * @param[in] shard
+ * Index of the worker
+ * @param[in] processName
+ * Name of the worker's process track
+ *
+ * @return
+ * SUCCESS if successful; FAILURE otherwise
+ */
+int
+traceWriteShard(
+        int shard,
+        const std::string &processName);
+
+/** @brief This function writes the trace: the calling process's events
+ * followed by those of shards 0 to numShards - 1, which are removed
+ *
+ * @param[in] numShards
+ * Number of forked workers, or 0 if workers were threads
+ * @param[in] processName
+ * Name of the calling process's track
+ *
+ * @return
+ * SUCCESS if successful; FAILURE otherwise
+ */
+int
+traceFinish(
+        int numShards,
+        const std::string &processName);
+
+#endif /* TRACE_H_ */
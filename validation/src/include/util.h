@@ -11,8 +11,10 @@
 #ifndef UTIL_H_
 #define UTIL_H_
 
+#include <functional>
 #include <iostream>
 #include "frpc.h"
+#include "perfcounters.h"
 
 #define SUCCESS 0
 #define FAILURE 1
@@ -25,6 +27,7 @@
 enum class Action {
     CreateTemplate_11,
     Match_11,
+    Matrix_11,
     Enroll_1N,
     Finalize_1N,
     Search_1N
@@ -42,8 +45,66 @@ enum class Action {
 const char*
 to_string(Action action);
 
-/** @brief This function reads a PPM file into a FRPC::Image data
- * structure
+/** @brief This function maps a whole file into memory
+ *
+ * @details The mapping is read-only unless writable is set, in which
+ * case it is private, so writes are copy-on-write and never reach the
+ * file.  A writable mapping may be charged in full against the commit
+ * limit, so only request one for data handed to implementations.
+ *
+ * @param[in] file
+ * Path to the file
+ * @param[out] mapping
+ * Pointer to the first byte of the mapping, which is unmapped
+ * when the last copy of the pointer is released
+ * @param[out] length
+ * Size of the mapping in bytes
+ * @param[in] writable
+ * Whether the mapping may be written
+ *
+ * @return
+ * true if successful; false otherwise
+ */
+bool
+mapFile(
+        const std::string &file,
+        std::shared_ptr<uint8_t> &mapping,
+        size_t &length,
+        bool writable = false);
+
+/** @brief This function maps zero-filled memory that is shared with
+ * child processes forked after the call
+ *
+ * @param[in] length
+ * Size of the mapping in bytes
+ * @param[out] mapping
+ * Pointer to the first byte of the mapping, which is unmapped
+ * when the last copy of the pointer is released
+ *
+ * @return
+ * true if successful; false otherwise
+ */
+bool
+mapShared(
+        size_t length,
+        std::shared_ptr<uint8_t> &mapping);
+
+/** @brief This function creates a directory, which may already exist
+ *
+ * @param[in] dir
+ * Path of the directory
+ *
+ * @return
+ * true if successful; false otherwise
+ */
+bool
+makeDirectory(const std::string &dir);
+
+/** @brief This function reads a binary PPM (colour) or PGM
+ * (greyscale) file into a FRPC::Image data structure
+ *
+ * @details The file is memory-mapped and the image data points into
+ * the mapping, which stays alive as long as the image data does.
  *
  * @param[in] file
  * Path to image file
@@ -69,26 +130,81 @@ readImage(const std::string &file, FRPC::Image &image);
 const char*
 to_string(FRPC::ReturnCode code);
 
-/** @brief This function takes an input file and splits the contents
- * into different files depending on the provided numForks parameter
- *
- * @param[in] inputFile
- * Path to input file
- * @param[in] outputDir
- * Path to the output directory where the split files will be written to
- * @param[in,out] numForks
- * The number of files to split the input file into.
- * @param[out] fileVector
- * A list of file paths to the newly created split files
+/** @brief This function runs one unit of work per thread and waits
+ * for all of them to finish
+ *
+ * @param[in] numWorkers
+ * The number of threads to start
+ * @param[in] work
+ * Function called as work(i) on thread i, for i in [0, numWorkers),
+ * returning SUCCESS or FAILURE
+ *
+ * @return
+ * SUCCESS if every call returned SUCCESS; FAILURE otherwise
+ */
+int
+runThreads(
+        int numWorkers,
+        const std::function<int(int)> &work);
+
+/** @brief This function calls createTemplates() on an implementation
+ * and checks that it produced one result per input image
+ *
+ * @details If the batch call as a whole returns a non-successful status,
+ * every image in the batch is given that status and an empty template.
+ *
+ * @param[in] impl
+ * The implementation under test (IdentInterface or VerifInterface)
+ * @param[in] faces
+ * The input face images
+ * @param[in] role
+ * The role of the templates to be generated
+ * @param[out] templs
+ * One template per input image
+ * @param[out] eyes
+ * One EyePair per input image
+ * @param[out] status
+ * One ReturnStatus per input image
+ * @param[in,out] meter
+ * The worker's CallMeter, which measures the createTemplates() call
  *
  * @return
- * EXIT_SUCCESS if successful; EXIT_FAILURE otherwise
+ * SUCCESS if the implementation returned well-formed results;
+ * FAILURE otherwise
  */
+template<typename Interface>
 int
-splitInputFile(
-        const std::string &inputFile,
-        const std::string &outputDir,
-        int &numForks,
-        std::vector<std::string> &fileVector);
+createTemplateBatch(
+        Interface &impl,
+        const std::vector<FRPC::Image> &faces,
+        FRPC::TemplateRole role,
+        std::vector<std::vector<uint8_t>> &templs,
+        std::vector<FRPC::EyePair> &eyes,
+        std::vector<FRPC::ReturnStatus> &status,
+        CallMeter &meter)
+{
+    templs.clear();
+    eyes.clear();
+    status.clear();
+    meter.begin();
+    auto ret = impl.createTemplates(faces, role, templs, eyes, status);
+    meter.end(TimedCall::CreateTemplates, faces.size());
+    if (ret.code != FRPC::ReturnCode::Success) {
+        templs.assign(faces.size(), std::vector<uint8_t>());
+        eyes.assign(faces.size(), FRPC::EyePair());
+        status.assign(faces.size(), ret);
+        return SUCCESS;
+    }
+
+    if (templs.size() != faces.size() || eyes.size() != faces.size() ||
+            status.size() != faces.size()) {
+        std::cerr << "createTemplates() returned " << templs.size() <<
+                " templates, " << eyes.size() << " eye pairs and " <<
+                status.size() << " return statuses for " << faces.size() <<
+                " images." << std::endl;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
 
 #endif /* UTIL_H_ */
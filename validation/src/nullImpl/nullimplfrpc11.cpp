@@ -34,6 +34,13 @@ NullImplFRPC11::setGPU(uint8_t gpuNum)
 	return ReturnStatus(ReturnCode::Success);
 }
 
+bool
+NullImplFRPC11::isThreadSafe() const
+{
+    /* No state is modified after initialization */
+    return true;
+}
+
 ReturnStatus
 NullImplFRPC11::createTemplate(
         const Image &face,
@@ -60,6 +67,17 @@ NullImplFRPC11::matchTemplates(
     return ReturnStatus(ReturnCode::Success);
 }
 
+ReturnStatus
+NullImplFRPC11::matchTemplates(
+        const TemplateView &verifTemplate,
+        const TemplateView &enrollTemplate,
+        double &similarity)
+{
+    /* Templates are read in place; nothing is copied */
+    similarity = 0.88;
+    return ReturnStatus(ReturnCode::Success);
+}
+
 std::shared_ptr<VerifInterface>
 VerifInterface::getImplementation()
 {
@@ -29,6 +29,11 @@ public:
     ReturnStatus
     setGPU(uint8_t gpuNum) override;
 
+    bool
+    isThreadSafe() const override;
+
+    using FRPC::VerifInterface::createTemplate;
+
     ReturnStatus
     createTemplate(
             const Image &face,
@@ -42,6 +47,12 @@ public:
             const std::vector<uint8_t> &enrollTemplate,
             double &similarity) override;
 
+    ReturnStatus
+    matchTemplates(
+            const TemplateView &verifTemplate,
+            const TemplateView &enrollTemplate,
+            double &similarity) override;
+
     static std::shared_ptr<FRPC::VerifInterface>
     getImplementation();
 
@@ -38,6 +38,13 @@ NullImplFRPC1N::setGPU(uint8_t gpuNum)
 	return ReturnStatus(ReturnCode::Success);
 }
 
+bool
+NullImplFRPC1N::isThreadSafe() const
+{
+    /* No state is modified after initialization */
+    return true;
+}
+
 ReturnStatus
 NullImplFRPC1N::createTemplate(
         const Image &face,
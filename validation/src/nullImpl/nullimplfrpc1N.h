@@ -29,6 +29,11 @@ public:
     ReturnStatus
     setGPU(uint8_t gpuNum) override;
 
+    bool
+    isThreadSafe() const override;
+
+    using FRPC::IdentInterface::createTemplate;
+
     ReturnStatus
     createTemplate(
             const Image &face,
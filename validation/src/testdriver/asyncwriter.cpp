@@ -0,0 +1,205 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "asyncwriter.h"
+#include "trace.h"
+#include "util.h"
+
+using namespace std;
+
+AsyncWriteBuffer::AsyncWriteBuffer() :
+    fd{-1},
+    current{0},
+    stopping{false},
+    failed{false}
+{}
+
+AsyncWriteBuffer::~AsyncWriteBuffer()
+{
+    this->close();
+}
+
+bool
+AsyncWriteBuffer::open(const string &file)
+{
+    if (this->fd != -1 && !this->close())
+        return false;
+
+    this->file = file;
+    this->fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (this->fd == -1)
+        return false;
+
+    this->buffers.assign(AsyncWriterBuffers, vector<char>(AsyncWriterBufferSize));
+    this->lengths.assign(AsyncWriterBuffers, 0);
+    this->freeBuffers.clear();
+    this->fullBuffers.clear();
+    for (size_t i = 1; i < AsyncWriterBuffers; i++)
+        this->freeBuffers.push_back(i);
+    this->current = 0;
+    this->setp(this->buffers[0].data(), this->buffers[0].data() +
+            this->buffers[0].size());
+    this->stopping = false;
+    this->failed = false;
+    this->thread = std::thread(&AsyncWriteBuffer::writeBehind, this);
+    return true;
+}
+
+bool
+AsyncWriteBuffer::is_open() const
+{
+    return (this->fd != -1);
+}
+
+bool
+AsyncWriteBuffer::close()
+{
+    if (this->fd == -1)
+        return true;
+
+    this->handOff(false);
+    {
+        lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->queued.notify_one();
+    this->thread.join();
+    this->setp(nullptr, nullptr);
+
+    if (::close(this->fd) != 0)
+        this->failed = true;
+    this->fd = -1;
+    if (this->failed)
+        cerr << "Error writing " << this->file << "." << endl;
+    return (!this->failed);
+}
+
+void
+AsyncWriteBuffer::handOff(bool next)
+{
+    size_t length = this->pptr() - this->pbase();
+    if (length == 0 && next)
+        return;
+
+    unique_lock<std::mutex> lock(this->mutex);
+    if (length > 0) {
+        this->lengths[this->current] = length;
+        this->fullBuffers.push_back(this->current);
+        this->queued.notify_one();
+    }
+    if (next) {
+        this->released.wait(lock, [this]() { return (!this->freeBuffers.empty()); });
+        this->current = this->freeBuffers.front();
+        this->freeBuffers.pop_front();
+        vector<char> &buffer = this->buffers[this->current];
+        this->setp(buffer.data(), buffer.data() + buffer.size());
+    } else
+        this->setp(this->pptr(), this->pptr());
+}
+
+AsyncWriteBuffer::int_type
+AsyncWriteBuffer::overflow(int_type c)
+{
+    if (this->fd == -1)
+        return traits_type::eof();
+    this->handOff(true);
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+        this->sputc(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+}
+
+int
+AsyncWriteBuffer::sync()
+{
+    if (this->fd == -1)
+        return -1;
+    this->handOff(true);
+    return 0;
+}
+
+void
+AsyncWriteBuffer::writeBehind()
+{
+    traceThread("log writer");
+    while (true) {
+        size_t index;
+        {
+            unique_lock<std::mutex> lock(this->mutex);
+            this->queued.wait(lock, [this]() {
+                return (this->stopping || !this->fullBuffers.empty()); });
+            if (this->fullBuffers.empty())
+                return;
+            index = this->fullBuffers.front();
+            this->fullBuffers.pop_front();
+        }
+
+        /* After a failure, keep releasing buffers so the writer never blocks */
+        TraceSpan span("writeLog");
+        span.setItems(this->lengths[index]);
+        const char *p = this->buffers[index].data();
+        size_t left = this->lengths[index];
+        while (left > 0 && !this->failed) {
+            ssize_t n = write(this->fd, p, left);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                this->failed = true;
+                break;
+            }
+            p += n;
+            left -= n;
+        }
+
+        {
+            lock_guard<std::mutex> lock(this->mutex);
+            this->freeBuffers.push_back(index);
+        }
+        this->released.notify_one();
+    }
+}
+
+AsyncWriter::AsyncWriter() :
+    std::ostream(nullptr)
+{
+    this->rdbuf(&this->buffer);
+}
+
+bool
+AsyncWriter::open(const string &file)
+{
+    if (!this->buffer.open(file)) {
+        this->setstate(ios::failbit);
+        return false;
+    }
+    this->clear();
+    return true;
+}
+
+bool
+AsyncWriter::is_open() const
+{
+    return (this->buffer.is_open());
+}
+
+bool
+AsyncWriter::close()
+{
+    this->flush();
+    if (!this->buffer.close()) {
+        this->setstate(ios::badbit);
+        return false;
+    }
+    return true;
+}
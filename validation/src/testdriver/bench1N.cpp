@@ -0,0 +1,494 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "frpc.h"
+#include "input.h"
+#include "latency.h"
+#include "perfcounters.h"
+#include "resources.h"
+#include "sharededb.h"
+#include "util.h"
+
+using namespace std;
+using namespace FRPC;
+
+/* Templates written to the EDB per SharedEDB::add() call */
+static const size_t SynthesisBatch = 4096;
+
+/* Candidate list length, as in validate1N */
+static const uint32_t CandListLength = 20;
+
+/**
+ * A template created from one image of the seed list
+ */
+struct SeedTemplate {
+    string id;
+    vector<uint8_t> templ;
+};
+
+void usage(const string &executable)
+{
+    cerr << "Usage: " << executable << " -c configDir -o outputDir -h outputStem "
+            "-i seedList -s searchList -n size[,size...] [-b batchSize] [-k]\n"
+            "  Measures how search scales with the size of the gallery, without\n"
+            "  enrolling each entry.\n"
+            "  seedList: images whose enrollment templates are cloned into a gallery\n"
+            "    (EDB and manifest) of each size, in outputDir/<size>, which is\n"
+            "    finalized into outputDir/<size>/enroll\n"
+            "  searchList: probes searched against each gallery\n"
+            "  batchSize: templates passed to each createTemplates() and\n"
+            "    identifyTemplates() call (default 1)\n"
+            "  -k: keep each gallery's EDB and manifest, which are otherwise removed\n"
+            "    once finalized\n"
+            "  outputDir/outputStem.scaling has one line per size with the EDB size,\n"
+            "  the seconds taken to synthesize, finalize and load the gallery,\n"
+            "  resident memory once loaded and at most while searching, and search\n"
+            "  latency percentiles and probes per second; each phase runs in a\n"
+            "  process of its own." << endl;
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Runs one phase in a child process of its own, as the phases of
+ * validate1N run in separate processes, and returns its status
+ */
+static int
+runPhase(
+        const string &name,
+        const function<int()> &phase)
+{
+    pid_t pid = fork();
+    if (pid == -1) {
+        cerr << "Problem forking" << endl;
+        return FAILURE;
+    }
+    if (pid == 0)
+        exit(phase() == SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    int status;
+    while (waitpid(pid, &status, 0) == -1)
+        if (errno != EINTR)
+            return FAILURE;
+    if (WIFSIGNALED(status)) {
+        cerr << name << " exited due to signal " << WTERMSIG(status) << endl;
+        return FAILURE;
+    }
+    return ((WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) ?
+            SUCCESS : FAILURE);
+}
+
+/**
+ * Creates enrollment templates from every image of the seed list and
+ * writes them to seedDir/edb and seedDir/manifest
+ */
+static int
+createSeeds(
+        const string &configDir,
+        const string &seedList,
+        const string &seedDir,
+        int batchSize,
+        WorkerLatency &latency)
+{
+    auto implPtr = IdentInterface::getImplementation();
+    CallMeter meter(latency, nullptr);
+    meter.begin();
+    auto ret = implPtr->initializeEnrollmentSession(configDir);
+    meter.end(TimedCall::InitializeEnrollmentSession, 1);
+    if (ret.code != ReturnCode::Success) {
+        cerr << "initializeEnrollmentSession() returned error code: "
+                << to_string(ret.code) << "." << endl;
+        return FAILURE;
+    }
+
+    InputList inputList;
+    int numParts = 1;
+    SharedEDB edb;
+    if (inputList.open(seedList, numParts) != SUCCESS ||
+            !edb.create(seedDir + "/edb", seedDir + "/manifest"))
+        return FAILURE;
+    auto reader = inputList.reader(0);
+    if (!reader)
+        return FAILURE;
+
+    string id, imagePath;
+    vector<string> ids;
+    vector<Image> faces;
+    while (true) {
+        ids.clear();
+        faces.clear();
+        while ((int)faces.size() < batchSize && reader->next(id, imagePath)) {
+            Image face;
+            if (!reader->readImage(face)) {
+                cerr << "Failed to load image file: " << imagePath << "." << endl;
+                return FAILURE;
+            }
+            ids.push_back(id);
+            faces.push_back(face);
+        }
+        if (faces.empty())
+            break;
+
+        vector<vector<uint8_t>> templs;
+        vector<EyePair> eyes;
+        vector<ReturnStatus> rets;
+        if (createTemplateBatch(*implPtr, faces, TemplateRole::Enrollment_1N,
+                templs, eyes, rets, meter) != SUCCESS)
+            return FAILURE;
+
+        /* Only templates that were created are worth cloning */
+        vector<string> seedIDs;
+        vector<vector<uint8_t>> seedTempls;
+        for (size_t i = 0; i < faces.size(); i++) {
+            if (rets[i].code != ReturnCode::Success || templs[i].empty())
+                continue;
+            seedIDs.push_back(ids[i]);
+            seedTempls.push_back(move(templs[i]));
+        }
+        if (!edb.add(seedIDs, seedTempls))
+            return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/** Reads the templates written by createSeeds() */
+static int
+readSeeds(
+        const string &seedDir,
+        vector<SeedTemplate> &seeds)
+{
+    const string edbFile{seedDir + "/edb"}, manifestFile{seedDir + "/manifest"};
+    shared_ptr<uint8_t> edb;
+    size_t edbLength = 0;
+    ifstream manifest(manifestFile);
+    if (!manifest.is_open()) {
+        cerr << "Failed to open stream for " << manifestFile << "." << endl;
+        return FAILURE;
+    }
+    string id;
+    uint64_t size, offset;
+    while (manifest >> id >> size >> offset) {
+        if (edb == nullptr && !mapFile(edbFile, edb, edbLength))
+            return FAILURE;
+        if (offset + size > edbLength) {
+            cerr << "Template " << id << " lies outside " << edbFile << "." << endl;
+            return FAILURE;
+        }
+        seeds.push_back(SeedTemplate());
+        seeds.back().id = id;
+        seeds.back().templ.assign(edb.get() + offset, edb.get() + offset + size);
+    }
+    if (seeds.empty()) {
+        cerr << "No template could be created from the seed list." << endl;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Writes an EDB and manifest of size entries to dir by cloning the seed
+ * templates in turn.  Clone k of a seed is named seedID.k, and the first
+ * clone keeps the seed's own ID, so that probes mated with the seeds
+ * stay mated.
+ */
+static int
+synthesize(
+        const vector<SeedTemplate> &seeds,
+        uint64_t size,
+        const string &dir,
+        uint64_t &bytes)
+{
+    SharedEDB edb;
+    if (!edb.create(dir + "/edb", dir + "/manifest"))
+        return FAILURE;
+
+    bytes = 0;
+    vector<string> ids;
+    vector<vector<uint8_t>> templs;
+    for (uint64_t entry = 0; entry < size; ) {
+        ids.clear();
+        templs.clear();
+        for (; entry < size && ids.size() < SynthesisBatch; entry++) {
+            const SeedTemplate &seed = seeds[entry % seeds.size()];
+            uint64_t clone = entry / seeds.size();
+            ids.push_back(clone == 0 ? seed.id : seed.id + "." + to_string(clone));
+            templs.push_back(seed.templ);
+            bytes += seed.templ.size();
+        }
+        if (!edb.add(ids, templs))
+            return FAILURE;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Initializes search on a finalized enrollment directory, creates the
+ * probe templates and searches them batchSize at a time
+ */
+static int
+search(
+        const string &configDir,
+        const string &enrollDir,
+        const string &searchList,
+        int batchSize,
+        WorkerLatency &latency,
+        ResourceRecorder &resources,
+        int worker)
+{
+    auto implPtr = IdentInterface::getImplementation();
+    CallMeter meter(latency, nullptr);
+    meter.begin();
+    auto ret = implPtr->initializeProbeTemplateSession(configDir, enrollDir);
+    meter.end(TimedCall::InitializeProbeTemplateSession, 1);
+    if (ret.code != ReturnCode::Success) {
+        cerr << "initializeProbeTemplateSession() returned error code: "
+                << to_string(ret.code) << "." << endl;
+        return FAILURE;
+    }
+    meter.begin();
+    ret = implPtr->initializeIdentificationSession(configDir, enrollDir);
+    meter.end(TimedCall::InitializeIdentificationSession, 1);
+    if (ret.code != ReturnCode::Success) {
+        cerr << "initializeIdentificationSession() returned error code: "
+                << to_string(ret.code) << "." << endl;
+        return FAILURE;
+    }
+    resources.sample(worker, "load", ResourceScope::Process);
+
+    InputList inputList;
+    int numParts = 1;
+    if (inputList.open(searchList, numParts) != SUCCESS)
+        return FAILURE;
+    auto reader = inputList.reader(0);
+    if (!reader)
+        return FAILURE;
+
+    string id, imagePath;
+    vector<Image> faces;
+    while (true) {
+        faces.clear();
+        while ((int)faces.size() < batchSize && reader->next(id, imagePath)) {
+            Image face;
+            if (!reader->readImage(face)) {
+                cerr << "Failed to load image file: " << imagePath << "." << endl;
+                return FAILURE;
+            }
+            faces.push_back(face);
+        }
+        if (faces.empty())
+            break;
+
+        vector<vector<uint8_t>> templs;
+        vector<EyePair> eyes;
+        vector<ReturnStatus> rets;
+        if (createTemplateBatch(*implPtr, faces, TemplateRole::Search_1N,
+                templs, eyes, rets, meter) != SUCCESS)
+            return FAILURE;
+        vector<const vector<uint8_t>*> probes;
+        for (size_t i = 0; i < faces.size(); i++)
+            if (rets[i].code == ReturnCode::Success)
+                probes.push_back(&templs[i]);
+        if (probes.empty())
+            continue;
+
+        vector<vector<Candidate>> candidateLists;
+        vector<bool> decisions;
+        meter.begin();
+        ret = implPtr->identifyTemplates(probes, CandListLength, candidateLists,
+                decisions, rets);
+        meter.end(TimedCall::IdentifyTemplates, probes.size());
+        if (ret.code != ReturnCode::Success) {
+            cerr << "identifyTemplates() returned error code: "
+                    << to_string(ret.code) << "." << endl;
+            return FAILURE;
+        }
+    }
+    resources.sample(worker, "search", ResourceScope::Process);
+    return SUCCESS;
+}
+
+int
+main(
+        int argc,
+        char* argv[])
+{
+    string configDir{"config"},
+        outputDir{"output"},
+        outputFileStem{"bench1N"},
+        seedList,
+        searchList;
+    vector<uint64_t> sizes;
+    int batchSize = 1;
+    bool keepEDB = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i],"-c") == 0 && i + 1 < argc)
+            configDir = argv[++i];
+        else if (strcmp(argv[i],"-o") == 0 && i + 1 < argc)
+            outputDir = argv[++i];
+        else if (strcmp(argv[i],"-h") == 0 && i + 1 < argc)
+            outputFileStem = argv[++i];
+        else if (strcmp(argv[i],"-i") == 0 && i + 1 < argc)
+            seedList = argv[++i];
+        else if (strcmp(argv[i],"-s") == 0 && i + 1 < argc)
+            searchList = argv[++i];
+        else if (strcmp(argv[i],"-b") == 0 && i + 1 < argc)
+            batchSize = atoi(argv[++i]);
+        else if (strcmp(argv[i],"-k") == 0)
+            keepEDB = true;
+        else if (strcmp(argv[i],"-n") == 0 && i + 1 < argc) {
+            stringstream list(argv[++i]);
+            string size;
+            while (getline(list, size, ','))
+                sizes.push_back(strtoull(size.c_str(), nullptr, 10));
+        } else {
+            cerr << "Unrecognized flag: " << argv[i] << endl;
+            usage(argv[0]);
+        }
+    }
+    if (seedList.empty() || searchList.empty() || sizes.empty()) {
+        cerr << "A seed list, a search list and at least one size are required." << endl;
+        usage(argv[0]);
+    }
+    if (batchSize < 1) {
+        cerr << "Batch size must be at least 1." << endl;
+        usage(argv[0]);
+    }
+    for (uint64_t size : sizes) {
+        if (size == 0) {
+            cerr << "Sizes must be at least 1." << endl;
+            usage(argv[0]);
+        }
+    }
+
+    /*
+     * Seed templates are created once, and every timed phase runs in a
+     * child process, recording into shared memory: worker 0 is the
+     * seeding, worker i + 1 gallery size i
+     */
+    const int numSizes = sizes.size();
+    LatencyRecorder latency;
+    ResourceRecorder resources;
+    if (!latency.create(numSizes + 1) || !resources.create(numSizes + 1))
+        return FAILURE;
+
+    const string seedDir{outputDir + "/seed"};
+    vector<SeedTemplate> seeds;
+    if (!makeDirectory(outputDir) || !makeDirectory(seedDir) ||
+            runPhase("Seeding", [&]() -> int {
+                return createSeeds(configDir, seedList, seedDir, batchSize,
+                        latency.worker(0)); }) != SUCCESS ||
+            readSeeds(seedDir, seeds) != SUCCESS) {
+        cerr << "Failed to create seed templates from " << seedList << "." << endl;
+        return FAILURE;
+    }
+    cout << "Created " << seeds.size() << " seed templates." << endl;
+
+    /* Measure each gallery size in turn */
+    const string reportFile{outputDir + "/" + outputFileStem + ".scaling"};
+    ofstream report(reportFile);
+    if (!report.is_open()) {
+        cerr << "Failed to open stream for " << reportFile << "." << endl;
+        return FAILURE;
+    }
+    report << "size edbBytes synthesisSeconds finalizeSeconds loadSeconds "
+            "loadRssKiB searchMaxRssKiB probes searchP50us searchP99us "
+            "searchMaxus probesPerSecond\n" << fixed << setprecision(3);
+
+    for (int i = 0; i < numSizes; i++) {
+        const uint64_t size = sizes[i];
+        const int worker = i + 1;
+        const string galleryDir{outputDir + "/" + to_string(size)};
+        const string enrollDir{galleryDir + "/enroll"};
+        if (!makeDirectory(galleryDir) || !makeDirectory(enrollDir))
+            return FAILURE;
+
+        uint64_t edbBytes = 0, startNs = monotonicNs();
+        if (synthesize(seeds, size, galleryDir, edbBytes) != SUCCESS) {
+            cerr << "Failed to synthesize a gallery of " << size << "." << endl;
+            return FAILURE;
+        }
+        const double synthesisSeconds = (monotonicNs() - startNs) / 1e9;
+
+        if (runPhase("Finalization", [&]() -> int {
+                auto implPtr = IdentInterface::getImplementation();
+                CallMeter meter(latency.worker(worker), nullptr);
+                meter.begin();
+                auto ret = implPtr->finalizeEnrollment(enrollDir,
+                        galleryDir + "/edb", galleryDir + "/manifest");
+                meter.end(TimedCall::FinalizeEnrollment, size);
+                if (ret.code != ReturnCode::Success) {
+                    cerr << "finalizeEnrollment() returned error code: "
+                            << to_string(ret.code) << "." << endl;
+                    return FAILURE;
+                }
+                resources.sample(worker, "finalize", ResourceScope::Process);
+                return SUCCESS; }) != SUCCESS) {
+            cerr << "Failed to finalize a gallery of " << size << "." << endl;
+            return FAILURE;
+        }
+        /* Search only has the enrollment directory to go on */
+        if (!keepEDB) {
+            remove((galleryDir + "/edb").c_str());
+            remove((galleryDir + "/manifest").c_str());
+        }
+
+        if (runPhase("Search", [&]() -> int {
+                return search(configDir, enrollDir, searchList, batchSize,
+                        latency.worker(worker), resources, worker); }) != SUCCESS) {
+            cerr << "Failed to search a gallery of " << size << "." << endl;
+            return FAILURE;
+        }
+
+        WorkerLatency &calls = latency.worker(worker);
+        const LatencyHistogram &finalize = calls[TimedCall::FinalizeEnrollment];
+        const LatencyHistogram &identify = calls[TimedCall::IdentifyTemplates];
+        const uint64_t loadNs =
+                calls[TimedCall::InitializeProbeTemplateSession].totalNs +
+                calls[TimedCall::InitializeIdentificationSession].totalNs;
+        ResourceSample load, searched;
+        if (!resources.find(worker, "load", load))
+            load.rssKiB = -1;
+        if (!resources.find(worker, "search", searched))
+            searched.maxRssKiB = 0;
+
+        report << size << " "
+                << edbBytes << " "
+                << synthesisSeconds << " "
+                << finalize.totalNs / 1e9 << " "
+                << loadNs / 1e9 << " "
+                << load.rssKiB << " "
+                << searched.maxRssKiB << " "
+                << identify.items << " "
+                << identify.percentile(0.5) / 1e3 << " "
+                << identify.percentile(0.99) / 1e3 << " "
+                << identify.maxNs / 1e3 << " "
+                << (identify.totalNs == 0 ? 0 : identify.items / (identify.totalNs / 1e9))
+                << endl;
+        cout << "Measured a gallery of " << size << "." << endl;
+    }
+
+    report.close();
+    if (!report) {
+        cerr << "Error writing " << reportFile << "." << endl;
+        return FAILURE;
+    }
+    return resources.writeReport(outputDir + "/" + outputFileStem + ".resources");
+}
@@ -0,0 +1,368 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <cstring>
+
+#include "columnar.h"
+#include "util.h"
+
+using namespace std;
+
+/** Returns the width in bytes of a value of a column type, or 0 if unknown */
+static size_t
+valueWidth(ColumnType type)
+{
+    switch (type) {
+    case ColumnType::UInt8: return 1;
+    case ColumnType::UInt32: return 4;
+    case ColumnType::Float64: return 8;
+    case ColumnType::String: return 4;
+    }
+    return 0;
+}
+
+static uint64_t
+padded(uint64_t length)
+{
+    return ((length + ColumnarAlignment - 1) / ColumnarAlignment * ColumnarAlignment);
+}
+
+static ColumnDescriptor
+describe(
+        const char *name,
+        ColumnType type)
+{
+    ColumnDescriptor d;
+    memset(&d, 0, sizeof(d));
+    strncpy(d.name, name, sizeof(d.name) - 1);
+    d.type = type;
+    return d;
+}
+
+vector<ColumnDescriptor>
+candidateListColumns()
+{
+    return {
+        describe("searchId", ColumnType::String),
+        describe("candidateRank", ColumnType::UInt32),
+        describe("searchRetCode", ColumnType::UInt8),
+        describe("isAssigned", ColumnType::UInt8),
+        describe("templateId", ColumnType::String),
+        describe("score", ColumnType::Float64),
+        describe("decision", ColumnType::UInt8)
+    };
+}
+
+vector<ColumnDescriptor>
+scoreColumns()
+{
+    return {
+        describe("enrollTempl", ColumnType::String),
+        describe("verifTempl", ColumnType::String),
+        describe("simScore", ColumnType::Float64),
+        describe("returnCode", ColumnType::UInt8)
+    };
+}
+
+ColumnWriter::ColumnWriter() :
+    rows{0},
+    numNewStrings{0}
+{}
+
+bool
+ColumnWriter::open(
+        const string &file,
+        const vector<ColumnDescriptor> &columns)
+{
+    if (!this->stream.open(file))
+        return false;
+    this->columns = columns;
+    this->values.assign(columns.size(), vector<uint8_t>());
+    for (size_t i = 0; i < columns.size(); i++)
+        this->values[i].reserve(ColumnarBlockRows * valueWidth(columns[i].type));
+    this->rows = 0;
+    this->stringIndex.clear();
+    this->newStrings.clear();
+    this->numNewStrings = 0;
+
+    ColumnarHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ColumnarMagic, sizeof(ColumnarMagic));
+    header.version = ColumnarVersion;
+    header.numColumns = columns.size();
+    this->stream.write((const char*)&header, sizeof(header));
+    this->stream.write((const char*)columns.data(),
+            columns.size() * sizeof(ColumnDescriptor));
+    return (this->stream.good());
+}
+
+void
+ColumnWriter::setInteger(
+        size_t column,
+        uint32_t value)
+{
+    if (this->columns[column].type == ColumnType::UInt8)
+        this->values[column].push_back(static_cast<uint8_t>(value));
+    else
+        this->values[column].insert(this->values[column].end(),
+                (const uint8_t*)&value, (const uint8_t*)&value + sizeof(value));
+}
+
+void
+ColumnWriter::setDouble(
+        size_t column,
+        double value)
+{
+    this->values[column].insert(this->values[column].end(),
+            (const uint8_t*)&value, (const uint8_t*)&value + sizeof(value));
+}
+
+void
+ColumnWriter::setString(
+        size_t column,
+        const string &value)
+{
+    auto it = this->stringIndex.find(value);
+    if (it == this->stringIndex.end()) {
+        it = this->stringIndex.insert(make_pair(value,
+                (uint32_t)this->stringIndex.size())).first;
+        this->newStrings.append(value.c_str(), value.size() + 1);
+        this->numNewStrings++;
+    }
+    this->setInteger(column, it->second);
+}
+
+void
+ColumnWriter::endRow()
+{
+    if (++this->rows == ColumnarBlockRows)
+        this->writeBlock();
+}
+
+void
+ColumnWriter::writeBlock()
+{
+    static const char padding[ColumnarAlignment] = {0};
+
+    ColumnarBlockHeader header;
+    header.rows = this->rows;
+    header.numStrings = this->numNewStrings;
+    header.stringBytes = this->newStrings.size();
+    this->stream.write((const char*)&header, sizeof(header));
+    this->stream.write(this->newStrings.data(), this->newStrings.size());
+    this->stream.write(padding, padded(header.stringBytes) - header.stringBytes);
+    for (auto &column : this->values) {
+        this->stream.write((const char*)column.data(), column.size());
+        this->stream.write(padding, padded(column.size()) - column.size());
+        column.clear();
+    }
+
+    this->rows = 0;
+    this->newStrings.clear();
+    this->numNewStrings = 0;
+}
+
+bool
+ColumnWriter::close()
+{
+    if (this->rows > 0)
+        this->writeBlock();
+    return (this->stream.close());
+}
+
+ColumnReader::ColumnReader() :
+    length{0},
+    nextOffset{0},
+    blockRows{0},
+    failed{false}
+{}
+
+bool
+ColumnReader::fail(const string &reason)
+{
+    cerr << "The columnar log " << this->file << " " << reason << "." << endl;
+    this->failed = true;
+    return false;
+}
+
+bool
+ColumnReader::open(const string &file)
+{
+    this->file = file;
+    if (!mapFile(file, this->mapping, this->length))
+        return false;
+
+    const uint8_t *base = this->mapping.get();
+    const ColumnarHeader *header = reinterpret_cast<const ColumnarHeader*>(base);
+    if (this->length < sizeof(ColumnarHeader) ||
+            memcmp(header->magic, ColumnarMagic, sizeof(ColumnarMagic)) != 0 ||
+            header->version != ColumnarVersion)
+        return (this->fail("is not a version " + to_string(ColumnarVersion) +
+                " columnar log"));
+    if ((this->length - sizeof(ColumnarHeader)) / sizeof(ColumnDescriptor) <
+            header->numColumns)
+        return (this->fail("is truncated"));
+
+    const ColumnDescriptor *d = reinterpret_cast<const ColumnDescriptor*>(
+            base + sizeof(ColumnarHeader));
+    this->descriptors.assign(d, d + header->numColumns);
+    for (const auto &descriptor : this->descriptors)
+        if (valueWidth(descriptor.type) == 0 ||
+                memchr(descriptor.name, '\0', sizeof(descriptor.name)) == nullptr)
+            return (this->fail("has a corrupt column descriptor"));
+
+    this->strings.clear();
+    this->nextOffset = sizeof(ColumnarHeader) +
+            header->numColumns * sizeof(ColumnDescriptor);
+    this->blockRows = 0;
+    this->blockColumns.assign(header->numColumns, nullptr);
+    this->failed = false;
+    return true;
+}
+
+const vector<ColumnDescriptor>&
+ColumnReader::columns() const
+{
+    return (this->descriptors);
+}
+
+bool
+ColumnReader::nextBlock()
+{
+    this->blockRows = 0;
+    if (this->failed || this->nextOffset == this->length)
+        return false;
+
+    const uint8_t *base = this->mapping.get();
+    if (this->length - this->nextOffset < sizeof(ColumnarBlockHeader))
+        return (this->fail("is truncated"));
+    ColumnarBlockHeader header;
+    memcpy(&header, base + this->nextOffset, sizeof(header));
+    uint64_t offset = this->nextOffset + sizeof(header);
+
+    /* Add the block's strings to the string table */
+    if (header.stringBytes > this->length - offset)
+        return (this->fail("is truncated"));
+    const char *p = reinterpret_cast<const char*>(base + offset);
+    const char *end = p + header.stringBytes;
+    for (uint32_t i = 0; i < header.numStrings; i++) {
+        const char *nul = static_cast<const char*>(memchr(p, '\0', end - p));
+        if (nul == nullptr)
+            return (this->fail("has a corrupt string table"));
+        this->strings.push_back(p);
+        p = nul + 1;
+    }
+    offset += padded(header.stringBytes);
+
+    for (size_t c = 0; c < this->descriptors.size(); c++) {
+        uint64_t bytes = padded((uint64_t)header.rows *
+                valueWidth(this->descriptors[c].type));
+        if (offset > this->length || bytes > this->length - offset)
+            return (this->fail("is truncated"));
+        this->blockColumns[c] = base + offset;
+        offset += bytes;
+    }
+
+    /* Every string index must be in the table read so far */
+    for (size_t c = 0; c < this->descriptors.size(); c++) {
+        if (this->descriptors[c].type != ColumnType::String)
+            continue;
+        for (uint32_t r = 0; r < header.rows; r++) {
+            uint32_t index;
+            memcpy(&index, this->blockColumns[c] + r * sizeof(index), sizeof(index));
+            if (index >= this->strings.size())
+                return (this->fail("has a corrupt string index"));
+        }
+    }
+
+    this->nextOffset = offset;
+    this->blockRows = header.rows;
+    return true;
+}
+
+bool
+ColumnReader::error() const
+{
+    return (this->failed);
+}
+
+uint32_t
+ColumnReader::rows() const
+{
+    return (this->blockRows);
+}
+
+const void*
+ColumnReader::column(size_t column) const
+{
+    return (this->blockColumns[column]);
+}
+
+uint32_t
+ColumnReader::integer(
+        size_t column,
+        uint32_t row) const
+{
+    if (this->descriptors[column].type == ColumnType::UInt8)
+        return (this->blockColumns[column][row]);
+    uint32_t value;
+    memcpy(&value, this->blockColumns[column] + row * sizeof(value), sizeof(value));
+    return value;
+}
+
+double
+ColumnReader::real(
+        size_t column,
+        uint32_t row) const
+{
+    double value;
+    memcpy(&value, this->blockColumns[column] + row * sizeof(value), sizeof(value));
+    return value;
+}
+
+const char*
+ColumnReader::text(
+        size_t column,
+        uint32_t row) const
+{
+    return (this->strings[this->integer(column, row)]);
+}
+
+void
+ColumnReader::writeTextHeader(ostream &stream) const
+{
+    for (size_t c = 0; c < this->descriptors.size(); c++)
+        stream << (c == 0 ? "" : " ") << this->descriptors[c].name;
+    stream << '\n';
+}
+
+void
+ColumnReader::writeTextRow(
+        ostream &stream,
+        uint32_t row) const
+{
+    for (size_t c = 0; c < this->descriptors.size(); c++) {
+        if (c > 0)
+            stream << ' ';
+        switch (this->descriptors[c].type) {
+        case ColumnType::UInt8:
+        case ColumnType::UInt32:
+            stream << this->integer(c, row);
+            break;
+        case ColumnType::Float64:
+            stream << this->real(c, row);
+            break;
+        case ColumnType::String:
+            stream << this->text(c, row);
+            break;
+        }
+    }
+    stream << '\n';
+}
@@ -0,0 +1,66 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#include <iostream>
+#include <unistd.h>
+
+#include "asyncwriter.h"
+#include "columnar.h"
+#include "merge.h"
+#include "util.h"
+
+using namespace std;
+
+void usage(const string &executable)
+{
+    cerr << "Usage: " << executable << " columnarLog textLog" << endl;
+    exit(EXIT_FAILURE);
+}
+
+int
+main(
+        int argc,
+        char* argv[])
+{
+    if (argc != 3)
+        usage(argv[0]);
+
+    /* Convert the log, or each of its worker shards in order */
+    const string log{argv[1]};
+    vector<string> files;
+    if (access(log.c_str(), F_OK) == 0)
+        files.push_back(log);
+    else
+        for (int i = 0, numShards = countShards(log); i < numShards; i++)
+            files.push_back(shardFile(log, i));
+    if (files.empty()) {
+        cerr << "There is no " << log << " or shard of it." << endl;
+        return FAILURE;
+    }
+
+    AsyncWriter textStream;
+    if (!textStream.open(argv[2])) {
+        cerr << "Failed to open stream for " << argv[2] << "." << endl;
+        return FAILURE;
+    }
+    for (size_t i = 0; i < files.size(); i++) {
+        ColumnReader reader;
+        if (!reader.open(files[i]))
+            return FAILURE;
+        if (i == 0)
+            reader.writeTextHeader(textStream);
+        while (reader.nextBlock())
+            for (uint32_t row = 0; row < reader.rows(); row++)
+                reader.writeTextRow(textStream, row);
+        if (reader.error())
+            return FAILURE;
+    }
+    return (textStream.close() ? SUCCESS : FAILURE);
+}
@@ -0,0 +1,426 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "imagepack.h"
+#include "util.h"
+
+using namespace std;
+using namespace FRPC;
+
+/**
+ * One image size and how often it is drawn
+ */
+struct SizeChoice {
+    uint16_t width;
+    uint16_t height;
+    double weight;
+};
+
+/**
+ * One image to generate.  Sample 0 of a subject is its enrollment image;
+ * the others are probes.
+ */
+struct GenImage {
+    uint64_t id;
+    uint64_t subject;
+    uint32_t sample;
+    /** Whether the image is 8-bit grey rather than 24-bit colour */
+    bool grey;
+    string path;
+};
+
+/** Parameters every image is generated from */
+struct Corpus {
+    uint64_t seed;
+    vector<SizeChoice> sizes;
+};
+
+void usage(const string &executable)
+{
+    cerr << "Usage: " << executable << " -o outputDir -n numSubjects "
+            "[-m imagesPerSubject] [-x numNonmatedSubjects] [-i impostorsPerSubject] "
+            "[-s seed] [-S WxH[:weight][,WxH[:weight]...]] [-g greyFraction] "
+            "[-l flat|nested] [-p] [-T numThreads]\n"
+            "  Writes outputDir/enroll.txt, verif.txt, match.txt and search.txt, in\n"
+            "  the formats read by validate11 and validate1N, of synthetic images.\n"
+            "  The same arguments give the same images.\n"
+            "  imagesPerSubject: images of each subject, at least 2 (default 2)\n"
+            "  numNonmatedSubjects: subjects after the enrolled ones that are only\n"
+            "    searched (default 0)\n"
+            "  impostorsPerSubject: other subjects each enrollment template is\n"
+            "    matched against, besides its mate (default 1)\n"
+            "  seed: varies every image, its size and whether it is grey (default 0)\n"
+            "  -S: image sizes to choose from, weighted (default 480x640)\n"
+            "  -g: fraction of images written as 8-bit grey PGM rather than colour\n"
+            "    PPM (default 0)\n"
+            "  -l: images directly in outputDir/images, or in a subdirectory per\n"
+            "    1000 subjects (default flat)\n"
+            "  -p: write outputDir/enroll.pack, verif.pack and search.pack instead\n"
+            "    of image files, to pass as pack:FILE\n"
+            "  numThreads: threads writing image files (default 1)\n"
+            "  outputDir/match.truth gives whether each pair of match.txt is mated,\n"
+            "  and outputDir/search.truth the enrolled id each probe should find,\n"
+            "  or - if none." << endl;
+    exit(EXIT_FAILURE);
+}
+
+/** The splitmix64 finalizer, which spreads every input bit over the output */
+static uint64_t
+mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return (x ^ (x >> 31));
+}
+
+/** A hash of the seed and two values, the same on every run */
+static uint64_t
+hashOf(
+        uint64_t seed,
+        uint64_t a,
+        uint64_t b)
+{
+    return mix(mix(seed ^ mix(a)) ^ b);
+}
+
+/** Maps a hash to [0, 1) */
+static double
+unit(uint64_t hash)
+{
+    return ((hash >> 11) * (1.0 / 9007199254740992.0));
+}
+
+/** Parses WxH[:weight][,WxH[:weight]...] */
+static bool
+parseSizes(
+        const string &text,
+        vector<SizeChoice> &sizes)
+{
+    stringstream list(text);
+    string item;
+    while (getline(list, item, ',')) {
+        unsigned width = 0, height = 0;
+        double weight = 1;
+        char separator;
+        stringstream fields(item);
+        if (!(fields >> width >> separator >> height) || separator != 'x' ||
+                width == 0 || height == 0 || width > 65535 || height > 65535)
+            return false;
+        if (fields >> separator && (separator != ':' || !(fields >> weight) ||
+                weight <= 0))
+            return false;
+        sizes.push_back({(uint16_t)width, (uint16_t)height, weight});
+    }
+    return (!sizes.empty());
+}
+
+/**
+ * Draws an image: a background, a face-like ellipse with two eyes, and
+ * noise.  Background, skin tone and face proportions follow the subject;
+ * position, lighting and noise vary with each sample, so that images of
+ * one subject are alike but not identical.
+ */
+static Image
+render(
+        const Corpus &corpus,
+        const GenImage &g)
+{
+    const uint64_t subjectHash = hashOf(corpus.seed, g.subject, 0);
+    const uint64_t sampleHash = hashOf(corpus.seed, g.subject, g.sample + 1);
+
+    /* Size is drawn per image */
+    double total = 0;
+    for (const auto &size : corpus.sizes)
+        total += size.weight;
+    double draw = unit(hashOf(corpus.seed, g.id, 1)) * total;
+    const SizeChoice *size = &corpus.sizes.back();
+    for (const auto &choice : corpus.sizes) {
+        if (draw < choice.weight) {
+            size = &choice;
+            break;
+        }
+        draw -= choice.weight;
+    }
+    const int width = size->width, height = size->height;
+    const int channels = g.grey ? 1 : 3;
+
+    uint8_t background[3], skin[3];
+    for (int c = 0; c < 3; c++) {
+        background[c] = (subjectHash >> (8 * c)) & 0xff;
+        skin[c] = 120 + ((subjectHash >> (24 + 8 * c)) & 0x7f);
+    }
+    const double cx = width * (0.5 + 0.08 * (unit(mix(sampleHash)) - 0.5));
+    const double cy = height * (0.45 + 0.08 * (unit(mix(sampleHash + 1)) - 0.5));
+    const double rx = width * (0.22 + 0.06 * unit(mix(subjectHash)));
+    const double ry = height * (0.30 + 0.06 * unit(mix(subjectHash + 1)));
+    const double eyeY = cy - 0.2 * ry, eyeDX = 0.4 * rx, eyeR = 0.12 * rx;
+    const double light = 0.8 + 0.4 * unit(mix(sampleHash + 2));
+
+    shared_ptr<uint8_t> data(new uint8_t[(size_t)width * height * channels],
+            default_delete<uint8_t[]>());
+    uint8_t *p = data.get();
+    uint64_t noise = sampleHash | 1;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const double dx = (x - cx) / rx, dy = (y - cy) / ry;
+            const double le = (x - (cx - eyeDX)) * (x - (cx - eyeDX)) +
+                    (y - eyeY) * (y - eyeY);
+            const double re = (x - (cx + eyeDX)) * (x - (cx + eyeDX)) +
+                    (y - eyeY) * (y - eyeY);
+            int rgb[3];
+            for (int c = 0; c < 3; c++) {
+                if (le < eyeR * eyeR || re < eyeR * eyeR)
+                    rgb[c] = 30;
+                else if (dx * dx + dy * dy < 1)
+                    rgb[c] = skin[c] * light * (1.1 - 0.2 * dy);
+                else
+                    rgb[c] = background[c] * (0.7 + 0.3 * y / height);
+            }
+
+            /* xorshift64 noise of up to +/-8 per pixel */
+            noise ^= noise << 13;
+            noise ^= noise >> 7;
+            noise ^= noise << 17;
+            const int n = (int)(noise & 0xf) - 8;
+            if (g.grey)
+                *p++ = max(0, min(255,
+                        ((rgb[0] * 77 + rgb[1] * 150 + rgb[2] * 29) >> 8) + n));
+            else
+                for (int c = 0; c < 3; c++)
+                    *p++ = max(0, min(255, rgb[c] + n));
+        }
+    }
+    return (Image(width, height, g.grey ? 8 : 24, data));
+}
+
+/** Writes an image as a binary PGM (8-bit) or PPM (24-bit) file */
+static bool
+writeImage(
+        const string &file,
+        const Image &image)
+{
+    ofstream stream(file, ios::binary);
+    if (!stream.is_open()) {
+        cerr << "Failed to open stream for " << file << "." << endl;
+        return false;
+    }
+    stream << (image.depth == 8 ? "P5" : "P6") << "\n" << image.width << " " <<
+            image.height << "\n255\n";
+    stream.write((const char*)image.data.get(), image.size());
+    stream.close();
+    if (!stream) {
+        cerr << "Error writing " << file << "." << endl;
+        return false;
+    }
+    return true;
+}
+
+/** Writes "id path" lines for the given images */
+static bool
+writeList(
+        const string &file,
+        const vector<const GenImage*> &images)
+{
+    ofstream stream(file);
+    if (!stream.is_open()) {
+        cerr << "Failed to open stream for " << file << "." << endl;
+        return false;
+    }
+    for (const GenImage *g : images)
+        stream << g->id << " " << g->path << '\n';
+    stream.close();
+    if (!stream) {
+        cerr << "Error writing " << file << "." << endl;
+        return false;
+    }
+    return true;
+}
+
+/** Generates the images of a list into one image pack */
+static bool
+writePack(
+        const string &file,
+        const Corpus &corpus,
+        const vector<const GenImage*> &images)
+{
+    PackWriter writer;
+    if (!writer.open(file, images.size()))
+        return false;
+    for (const GenImage *g : images)
+        if (!writer.add(to_string(g->id), g->path, render(corpus, *g)))
+            return false;
+    return writer.close();
+}
+
+int
+main(
+        int argc,
+        char* argv[])
+{
+    string outputDir, layout{"flat"};
+    uint64_t numSubjects = 0, numNonmated = 0;
+    uint32_t imagesPerSubject = 2, impostors = 1;
+    int numThreads = 1;
+    bool pack = false;
+    Corpus corpus;
+    corpus.seed = 0;
+    double greyFraction = 0;
+    string sizes{"480x640"};
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i],"-o") == 0 && i + 1 < argc)
+            outputDir = argv[++i];
+        else if (strcmp(argv[i],"-n") == 0 && i + 1 < argc)
+            numSubjects = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i],"-m") == 0 && i + 1 < argc)
+            imagesPerSubject = atoi(argv[++i]);
+        else if (strcmp(argv[i],"-x") == 0 && i + 1 < argc)
+            numNonmated = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i],"-i") == 0 && i + 1 < argc)
+            impostors = atoi(argv[++i]);
+        else if (strcmp(argv[i],"-s") == 0 && i + 1 < argc)
+            corpus.seed = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i],"-S") == 0 && i + 1 < argc)
+            sizes = argv[++i];
+        else if (strcmp(argv[i],"-g") == 0 && i + 1 < argc)
+            greyFraction = atof(argv[++i]);
+        else if (strcmp(argv[i],"-l") == 0 && i + 1 < argc)
+            layout = argv[++i];
+        else if (strcmp(argv[i],"-T") == 0 && i + 1 < argc)
+            numThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i],"-p") == 0)
+            pack = true;
+        else {
+            cerr << "Unrecognized flag: " << argv[i] << endl;
+            usage(argv[0]);
+        }
+    }
+    if (outputDir.empty() || numSubjects == 0) {
+        cerr << "An output directory and at least one subject are required." << endl;
+        usage(argv[0]);
+    }
+    if (imagesPerSubject < 2) {
+        cerr << "Every subject needs at least two images to be mated." << endl;
+        usage(argv[0]);
+    }
+    if (!parseSizes(sizes, corpus.sizes)) {
+        cerr << "Sizes must be WxH[:weight], separated by commas." << endl;
+        usage(argv[0]);
+    }
+    if (greyFraction < 0 || greyFraction > 1 ||
+            (layout != "flat" && layout != "nested") || numThreads < 1) {
+        cerr << "The grey fraction must be in [0, 1], the layout flat or "
+                "nested, and the number of threads at least 1." << endl;
+        usage(argv[0]);
+    }
+    impostors = min<uint64_t>(impostors, numSubjects - 1);
+
+    /*
+     * Subjects [0, numSubjects) are enrolled with their first image and
+     * verified with their second; the nonmated subjects after them are
+     * only searched.  Every image but a subject's first is a probe.
+     * Nested layouts put up to 1000 subjects in each directory.
+     */
+    const string imageDir{outputDir + "/images"};
+    if (!makeDirectory(outputDir) || (!pack && !makeDirectory(imageDir)))
+        return FAILURE;
+    vector<GenImage> images;
+    images.reserve((numSubjects + numNonmated) * imagesPerSubject);
+    for (uint64_t s = 0; s < numSubjects + numNonmated; s++) {
+        string dir{imageDir};
+        if (layout == "nested") {
+            dir += "/" + to_string(s / 1000);
+            if (!pack && s % 1000 == 0 && !makeDirectory(dir))
+                return FAILURE;
+        }
+        for (uint32_t k = 0; k < imagesPerSubject; k++) {
+            GenImage g;
+            g.id = s * imagesPerSubject + k + 1;
+            g.subject = s;
+            g.sample = k;
+            g.grey = unit(hashOf(corpus.seed, g.id, 2)) < greyFraction;
+            g.path = dir + "/" + to_string(g.id) + (g.grey ? ".pgm" : ".ppm");
+            images.push_back(g);
+        }
+    }
+
+    vector<const GenImage*> enroll, verif, search;
+    for (const auto &g : images) {
+        if (g.subject < numSubjects && g.sample == 0)
+            enroll.push_back(&g);
+        if (g.subject < numSubjects && g.sample == 1)
+            verif.push_back(&g);
+        if (g.sample > 0)
+            search.push_back(&g);
+    }
+
+    /* Lists of images, and the truth for comparisons and searches */
+    if (!writeList(outputDir + "/enroll.txt", enroll) ||
+            !writeList(outputDir + "/verif.txt", verif) ||
+            !writeList(outputDir + "/search.txt", search))
+        return FAILURE;
+
+    const string matchFile{outputDir + "/match.txt"},
+        matchTruthFile{outputDir + "/match.truth"},
+        searchTruthFile{outputDir + "/search.truth"};
+    ofstream match(matchFile), matchTruth(matchTruthFile), searchTruth(searchTruthFile);
+    if (!match.is_open() || !matchTruth.is_open() || !searchTruth.is_open()) {
+        cerr << "Failed to open stream for " << matchFile << ", " << matchTruthFile <<
+                " or " << searchTruthFile << "." << endl;
+        return FAILURE;
+    }
+    for (uint64_t s = 0; s < numSubjects; s++) {
+        /* One mated comparison, then impostors from the next subjects */
+        for (uint32_t j = 0; j <= impostors; j++) {
+            const uint64_t other = (s + j) % numSubjects;
+            const string pair{to_string(enroll[s]->id) + ".template " +
+                    to_string(verif[other]->id) + ".template"};
+            match << pair << '\n';
+            matchTruth << pair << " " << (j == 0) << '\n';
+        }
+    }
+    for (const GenImage *g : search)
+        searchTruth << g->id << " " << (g->subject < numSubjects ?
+                to_string(enroll[g->subject]->id) : string("-")) << '\n';
+    match.close();
+    matchTruth.close();
+    searchTruth.close();
+    if (!match || !matchTruth || !searchTruth) {
+        cerr << "Error writing " << matchFile << ", " << matchTruthFile <<
+                " or " << searchTruthFile << "." << endl;
+        return FAILURE;
+    }
+
+    /* Images go to one pack per list, or to a file each */
+    if (pack) {
+        if (!writePack(outputDir + "/enroll.pack", corpus, enroll) ||
+                !writePack(outputDir + "/verif.pack", corpus, verif) ||
+                !writePack(outputDir + "/search.pack", corpus, search))
+            return FAILURE;
+    } else if (runThreads(numThreads, [&](int t) -> int {
+            for (size_t i = t; i < images.size(); i += numThreads)
+                if ((images[i].subject < numSubjects || images[i].sample > 0) &&
+                        !writeImage(images[i].path, render(corpus, images[i])))
+                    return FAILURE;
+            return SUCCESS; }) != SUCCESS)
+        return FAILURE;
+
+    cout << "Generated " << enroll.size() << " enrollment, " << verif.size() <<
+            " verification and " << search.size() << " search images in " <<
+            outputDir << "." << endl;
+    return SUCCESS;
+}
@@ -0,0 +1,70 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#include <iostream>
+
+#include "asyncwriter.h"
+#include "scorematrix.h"
+#include "util.h"
+
+using namespace std;
+
+void usage(const string &executable)
+{
+    cerr << "Usage: " << executable << " matrixFile textLog\n"
+            "  Writes every cell of a score matrix from validate11 matrix as a\n"
+            "  line of textLog, in the format of the match log, one verification\n"
+            "  template after the other.  The matrix records the names of its\n"
+            "  templates, so the lists it was made from are not needed." << endl;
+    exit(EXIT_FAILURE);
+}
+
+int
+main(
+        int argc,
+        char* argv[])
+{
+    if (argc != 3)
+        usage(argv[0]);
+
+    ScoreMatrix matrix;
+    if (!matrix.open(argv[1]))
+        return FAILURE;
+    AsyncWriter textStream;
+    if (!textStream.open(argv[2])) {
+        cerr << "Failed to open stream for " << argv[2] << "." << endl;
+        return FAILURE;
+    }
+
+    /* Cells whose comparison was never made have no line */
+    uint64_t missing = 0;
+    textStream << "enrollTempl verifTempl simScore returnCode\n";
+    for (uint64_t row = 0; row < matrix.rows(); row++) {
+        for (uint64_t col = 0; col < matrix.cols(); col++) {
+            const uint8_t code = matrix.code(row, col);
+            if (code == ScoreMatrixNotComputed) {
+                missing++;
+                continue;
+            }
+            textStream << matrix.colName(col) << " " << matrix.rowName(row) <<
+                    " " << matrix.score(row, col) << " " << (int)code << "\n";
+        }
+    }
+    if (!textStream.close()) {
+        cerr << "Error writing " << argv[2] << "." << endl;
+        return FAILURE;
+    }
+    if (missing > 0) {
+        cerr << missing << " comparisons of " << argv[1] <<
+                " were never made." << endl;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,40 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#include <cstring>
+#include <iostream>
+
+#include "merge.h"
+#include "util.h"
+
+using namespace std;
+
+void usage(const string &executable)
+{
+    cerr << "Usage: " << executable << " log logFile | edb edbDir" << endl;
+    exit(EXIT_FAILURE);
+}
+
+int
+main(
+        int argc,
+        char* argv[])
+{
+    if (argc != 3)
+        usage(argv[0]);
+
+    /* Join the per-worker shards of a log, or of an EDB and manifest */
+    if (strcmp(argv[1], "log") == 0)
+        return mergeLogs(argv[2]);
+    else if (strcmp(argv[1], "edb") == 0)
+        return mergeEDBShards(argv[2]);
+    usage(argv[0]);
+    return FAILURE;
+}
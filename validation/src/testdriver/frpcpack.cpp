@@ -0,0 +1,38 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ */
+
+#include <iostream>
+
+#include "imagepack.h"
+#include "util.h"
+
+using namespace std;
+
+void usage(const string &executable)
+{
+    cerr << "Usage: " << executable << " inputFile packFile" << endl;
+    exit(EXIT_FAILURE);
+}
+
+int
+main(
+        int argc,
+        char* argv[])
+{
+    if (argc != 3)
+        usage(argv[0]);
+
+    /* Decode every image of the input list into a single pack */
+    if (writeImagePack(argv[1], argv[2]) != SUCCESS) {
+        cerr << "Failed to create image pack " << argv[2] << "." << endl;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
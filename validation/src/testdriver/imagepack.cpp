@@ -0,0 +1,224 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <sys/mman.h>
+
+#include "imagepack.h"
+#include "util.h"
+
+using namespace std;
+using namespace FRPC;
+
+ImagePack::ImagePack() :
+    length{0},
+    header{nullptr},
+    entries{nullptr}
+{}
+
+bool
+ImagePack::open(const string &file)
+{
+    /* Pixels are handed to implementations in place */
+    if (!mapFile(file, this->mapping, this->length, true))
+        return false;
+
+    this->header = reinterpret_cast<const PackHeader*>(this->mapping.get());
+    if (this->length < sizeof(PackHeader) ||
+            memcmp(this->header->magic, PackMagic, sizeof(PackMagic)) != 0 ||
+            this->header->version != PackVersion ||
+            this->header->entrySize != sizeof(PackEntry)) {
+        cerr << file << " is not a version " << PackVersion <<
+                " image pack." << endl;
+        return false;
+    }
+    if (this->header->indexOffset > this->length ||
+            this->header->count > (this->length - this->header->indexOffset) /
+            sizeof(PackEntry)) {
+        cerr << "The index of image pack " << file << " is truncated." << endl;
+        return false;
+    }
+    this->entries = reinterpret_cast<const PackEntry*>(
+            this->mapping.get() + this->header->indexOffset);
+
+    for (uint64_t i = 0; i < this->header->count; i++) {
+        const PackEntry &e = this->entries[i];
+        if (e.offset > this->length || e.size > this->length - e.offset ||
+                e.size != (uint64_t)e.width * e.height * (e.depth / 8) ||
+                memchr(e.id, '\0', sizeof(e.id)) == nullptr ||
+                memchr(e.path, '\0', sizeof(e.path)) == nullptr) {
+            cerr << "Entry " << i << " of image pack " << file <<
+                    " is corrupt." << endl;
+            return false;
+        }
+    }
+
+    /* Workers walk their partition of the rasters front to back */
+    madvise(this->mapping.get(), this->length, MADV_SEQUENTIAL);
+    return true;
+}
+
+uint64_t
+ImagePack::size() const
+{
+    return (this->header == nullptr ? 0 : this->header->count);
+}
+
+string
+ImagePack::id(uint64_t i) const
+{
+    return (this->entries[i].id);
+}
+
+string
+ImagePack::path(uint64_t i) const
+{
+    return (this->entries[i].path);
+}
+
+bool
+ImagePack::readImage(
+        uint64_t i,
+        Image &image) const
+{
+    if (i >= this->size())
+        return false;
+
+    const PackEntry &e = this->entries[i];
+    image.width = e.width;
+    image.height = e.height;
+    image.depth = e.depth;
+    image.data = shared_ptr<uint8_t>(this->mapping,
+            this->mapping.get() + e.offset);
+    return true;
+}
+
+PackWriter::PackWriter() :
+    offset{0}
+{
+    memset(&this->header, 0, sizeof(this->header));
+}
+
+bool
+PackWriter::open(
+        const string &file,
+        uint64_t count)
+{
+    this->file = file;
+    this->stream.open(file, ios::binary);
+    if (!this->stream.is_open()) {
+        cerr << "Failed to open stream for " << file << "." << endl;
+        return false;
+    }
+
+    memcpy(this->header.magic, PackMagic, sizeof(PackMagic));
+    this->header.version = PackVersion;
+    this->header.entrySize = sizeof(PackEntry);
+    this->header.count = count;
+    this->header.indexOffset = sizeof(PackHeader);
+    this->header.dataOffset = this->header.indexOffset + count * sizeof(PackEntry);
+    this->header.dataOffset += (PackAlignment - this->header.dataOffset %
+            PackAlignment) % PackAlignment;
+    this->index.reserve(count);
+
+    /* Write the rasters first, then go back for the header and index */
+    this->offset = this->header.dataOffset;
+    this->stream.seekp(this->offset);
+    return true;
+}
+
+bool
+PackWriter::add(
+        const string &id,
+        const string &path,
+        const Image &image)
+{
+    if (this->index.size() == this->header.count) {
+        cerr << "More images added to " << this->file << " than it was "
+                "created for." << endl;
+        return false;
+    }
+    PackEntry e;
+    memset(&e, 0, sizeof(e));
+    if (id.size() >= sizeof(e.id) || path.size() >= sizeof(e.path)) {
+        cerr << "Identifier or path too long for an image pack: " <<
+                id << " " << path << endl;
+        return false;
+    }
+    memcpy(e.id, id.c_str(), id.size());
+    memcpy(e.path, path.c_str(), path.size());
+    e.width = image.width;
+    e.height = image.height;
+    e.depth = image.depth;
+    e.offset = this->offset;
+    e.size = image.size();
+    this->stream.write((const char*)image.data.get(), e.size);
+
+    static const char padding[PackAlignment] = {};
+    uint64_t pad = (PackAlignment - e.size % PackAlignment) % PackAlignment;
+    this->stream.write(padding, pad);
+    this->offset += e.size + pad;
+    this->index.push_back(e);
+    return this->stream.good();
+}
+
+bool
+PackWriter::close()
+{
+    if (this->index.size() != this->header.count) {
+        cerr << "Only " << this->index.size() << " of " << this->header.count <<
+                " images were added to " << this->file << "." << endl;
+        return false;
+    }
+    this->stream.seekp(0);
+    this->stream.write((const char*)&this->header, sizeof(this->header));
+    this->stream.write((const char*)this->index.data(),
+            this->index.size() * sizeof(PackEntry));
+    this->stream.close();
+    if (!this->stream) {
+        cerr << "Error writing image pack " << this->file << "." << endl;
+        return false;
+    }
+    return true;
+}
+
+int
+writeImagePack(
+        const string &inputFile,
+        const string &packFile)
+{
+    /* Read input file */
+    ifstream inputStream(inputFile);
+    if (!inputStream.is_open()) {
+        cerr << "Failed to open stream for " << inputFile << "." << endl;
+        return FAILURE;
+    }
+
+    vector<pair<string, string>> images;
+    string id, imagePath;
+    while (inputStream >> id >> imagePath)
+        images.push_back(make_pair(id, imagePath));
+
+    PackWriter writer;
+    if (!writer.open(packFile, images.size()))
+        return FAILURE;
+    for (const auto &image : images) {
+        Image face;
+        if (!readImage(image.second, face)) {
+            cerr << "Failed to load image file: " << image.second << "." << endl;
+            return FAILURE;
+        }
+        if (!writer.add(image.first, image.second, face))
+            return FAILURE;
+    }
+    return (writer.close() ? SUCCESS : FAILURE);
+}
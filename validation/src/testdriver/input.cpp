@@ -0,0 +1,692 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <new>
+
+#include "input.h"
+#include "trace.h"
+#include "util.h"
+
+using namespace std;
+using namespace FRPC;
+
+/**
+ * Finds the next whitespace-separated field of the text in [p, end)
+ * and advances p past it.  Returns false if there is none.
+ */
+static bool
+nextField(
+        const char *&p,
+        const char *end,
+        const char *&field,
+        size_t &length)
+{
+    while (p < end && isspace(static_cast<unsigned char>(*p)))
+        p++;
+    field = p;
+    while (p < end && !isspace(static_cast<unsigned char>(*p)))
+        p++;
+    length = p - field;
+    return (length > 0);
+}
+
+/**
+ * Copies the next whitespace-separated field of the text in [p, end)
+ * into field and advances p past it.  Returns false if there is none.
+ */
+static bool
+nextField(
+        const char *&p,
+        const char *end,
+        string &field)
+{
+    const char *begin;
+    size_t length;
+    if (!nextField(p, end, begin, length))
+        return false;
+    field.assign(begin, length);
+    return true;
+}
+
+TextReader::TextReader(
+        const char *begin,
+        const char *end) :
+    current{begin},
+    end{end}
+{}
+
+bool
+TextReader::next(
+        string &first,
+        string &second)
+{
+    if (!nextField(this->current, this->end, first) ||
+            !nextField(this->current, this->end, second))
+        return false;
+    this->imagePath = second;
+    return true;
+}
+
+bool
+TextReader::readImage(Image &image)
+{
+    return (::readImage(this->imagePath, image));
+}
+
+PackReader::PackReader(
+        const ImagePack &pack,
+        uint64_t begin,
+        uint64_t end) :
+    pack(pack),
+    current{begin},
+    end{end}
+{}
+
+bool
+PackReader::next(
+        string &first,
+        string &second)
+{
+    if (this->current == this->end)
+        return false;
+    first = this->pack.id(this->current);
+    second = this->pack.path(this->current);
+    this->current++;
+    return true;
+}
+
+bool
+PackReader::readImage(Image &image)
+{
+    return (this->pack.readImage(this->current - 1, image));
+}
+
+IndexedReader::IndexedReader(
+        const InputList &list,
+        int worker) :
+    list(list),
+    worker{worker},
+    current{0},
+    end{0},
+    entry{0}
+{
+    if (!list.isDynamic()) {
+        this->current = list.ranges[worker].first;
+        this->end = list.ranges[worker].second;
+    }
+}
+
+bool
+IndexedReader::next(
+        string &first,
+        string &second)
+{
+    /* Claim the next chunk once this one is used up */
+    while (this->current == this->end) {
+        if (!this->list.isDynamic())
+            return false;
+        uint64_t chunk = this->list.queueHeader->nextChunk.fetch_add(1);
+        if (chunk >= this->list.numChunks)
+            return false;
+        this->current = chunk * this->list.chunkSize;
+        this->end = min(this->current + this->list.chunkSize,
+                this->list.numEntries);
+    }
+
+    uint64_t position = this->current++;
+    this->entry = (this->list.order == nullptr ? position :
+            this->list.order[position]);
+    if (!this->list.fields(this->entry, first, second))
+        return false;
+    this->imagePath = second;
+    this->list.records[position].worker = this->worker;
+    this->unrecorded.push_back(position);
+    return true;
+}
+
+bool
+IndexedReader::readImage(Image &image)
+{
+    if (this->list.isPack())
+        return (this->list.pack.readImage(this->entry, image));
+    return (::readImage(this->imagePath, image));
+}
+
+void
+IndexedReader::recordLogLines(uint64_t lines)
+{
+    if (this->unrecorded.empty())
+        return;
+    this->list.records[this->unrecorded.front()].logLines += lines;
+    this->unrecorded.pop_front();
+}
+
+PrefetchReader::PrefetchReader(
+        unique_ptr<InputReader> reader,
+        size_t depth) :
+    reader{move(reader)},
+    ring(depth > 0 ? depth : 1),
+    head{0},
+    count{0},
+    finished{false},
+    stopping{false},
+    imageRead{false}
+{
+    this->thread = std::thread(&PrefetchReader::readAhead, this);
+}
+
+PrefetchReader::~PrefetchReader()
+{
+    {
+        lock_guard<mutex> lock(this->ringMutex);
+        this->stopping = true;
+    }
+    this->emptied.notify_one();
+    this->thread.join();
+}
+
+void
+PrefetchReader::readAhead()
+{
+    traceThread("prefetch");
+    while (true) {
+        /* Wait for a free slot; only this thread fills it */
+        size_t tail;
+        {
+            unique_lock<mutex> lock(this->ringMutex);
+            this->emptied.wait(lock, [this]() {
+                return (this->stopping || this->count < this->ring.size()); });
+            if (this->stopping)
+                return;
+            tail = (this->head + this->count) % this->ring.size();
+        }
+
+        Slot &slot = this->ring[tail];
+        bool read;
+        {
+            lock_guard<mutex> lock(this->readerMutex);
+            read = this->reader->next(slot.first, slot.second);
+        }
+        if (read) {
+            TraceSpan span("decodeImage");
+            slot.imageRead = this->reader->readImage(slot.image);
+            /* Fault the mapped pixels in now rather than in the worker */
+            if (slot.imageRead) {
+                const volatile uint8_t *data = slot.image.data.get();
+                for (size_t i = 0; i < slot.image.size(); i += 4096)
+                    (void)data[i];
+                span.setItems(1);
+            }
+        }
+
+        {
+            lock_guard<mutex> lock(this->ringMutex);
+            if (read)
+                this->count++;
+            else
+                this->finished = true;
+        }
+        this->filled.notify_one();
+        if (!read)
+            return;
+    }
+}
+
+bool
+PrefetchReader::next(
+        string &first,
+        string &second)
+{
+    {
+        unique_lock<mutex> lock(this->ringMutex);
+        this->filled.wait(lock, [this]() {
+            return (this->finished || this->count > 0); });
+        if (this->count == 0)
+            return false;
+
+        /* Swapping hands the slot the caller's strings to reuse */
+        Slot &slot = this->ring[this->head];
+        first.swap(slot.first);
+        second.swap(slot.second);
+        this->image = move(slot.image);
+        slot.image = Image();
+        this->imageRead = slot.imageRead;
+        this->head = (this->head + 1) % this->ring.size();
+        this->count--;
+    }
+    this->emptied.notify_one();
+    return true;
+}
+
+bool
+PrefetchReader::readImage(Image &image)
+{
+    if (!this->imageRead)
+        return false;
+    image = this->image;
+    return true;
+}
+
+void
+PrefetchReader::recordLogLines(uint64_t lines)
+{
+    lock_guard<mutex> lock(this->readerMutex);
+    this->reader->recordLogLines(lines);
+}
+
+bool
+isPackInput(const string &inputFile)
+{
+    return (inputFile.compare(0, strlen(PackInputPrefix), PackInputPrefix) == 0);
+}
+
+InputList::InputList() :
+    packInput{false},
+    listLength{0},
+    numEntries{0},
+    indexed{false},
+    chunkSize{0},
+    numChunks{0},
+    queueHeader{nullptr},
+    records{nullptr},
+    entryOffsets{nullptr},
+    order{nullptr}
+{}
+
+int
+InputList::open(
+        const string &inputFile,
+        int &numParts,
+        uint64_t chunkSize,
+        bool grouped)
+{
+    if (chunkSize > 0 || grouped)
+        return (this->openIndexed(inputFile, numParts, chunkSize, grouped));
+
+    if (isPackInput(inputFile)) {
+        this->packInput = true;
+        string packFile = inputFile.substr(strlen(PackInputPrefix));
+        if (!this->pack.open(packFile))
+            return FAILURE;
+
+        /* Divide the images into numParts contiguous, near-equal ranges */
+        uint64_t count = this->pack.size();
+        this->numEntries = count;
+        if (count < (uint64_t)numParts)
+            numParts = count;
+        for (int i = 0; i < numParts; i++)
+            this->ranges.push_back(make_pair(
+                    count * i / numParts, count * (i + 1) / numParts));
+        return SUCCESS;
+    }
+
+    if (!mapFile(inputFile, this->listMapping, this->listLength))
+        return FAILURE;
+    const char *text = reinterpret_cast<const char*>(this->listMapping.get());
+    const char *textEnd = text + this->listLength;
+
+    /* Count number of lines in file, including an unterminated last line */
+    uint64_t numLines = count(text, textEnd, '\n');
+    if (textEnd[-1] != '\n')
+        numLines++;
+    this->numEntries = numLines;
+
+    /**
+     * If the number of partitions is more than
+     * the number of lines in the file, set numParts
+     * to numLines
+     */
+    if (numLines < (uint64_t)numParts)
+        numParts = numLines;
+    /* This is the round-up of numLines/numParts */
+    uint64_t numLinesPerPart = (numLines + numParts - 1) / numParts;
+    /* re-assign the number of partitions if the numbers don't work out */
+    numParts = (numLines + numLinesPerPart - 1) / numLinesPerPart;
+
+    /* Each partition ends after numLinesPerPart newlines */
+    uint64_t begin{0}, line{0};
+    for (const char *p = text;
+            (p = static_cast<const char*>(memchr(p, '\n', textEnd - p))) != nullptr;
+            p++) {
+        if (++line % numLinesPerPart == 0) {
+            this->ranges.push_back(make_pair(begin, p + 1 - text));
+            begin = p + 1 - text;
+        }
+    }
+    if (begin < this->listLength)
+        this->ranges.push_back(make_pair(begin, (uint64_t)this->listLength));
+    return SUCCESS;
+}
+
+/**
+ * The fields of one entry of a text list, pointing into the list
+ */
+struct EntryFields {
+    const char *first;
+    size_t firstLength;
+    const char *second;
+    size_t secondLength;
+};
+
+/** Compares two fields as strings */
+static int
+compareFields(
+        const char *a,
+        size_t aLength,
+        const char *b,
+        size_t bLength)
+{
+    int cmp = memcmp(a, b, min(aLength, bLength));
+    if (cmp != 0)
+        return cmp;
+    return (aLength < bLength ? -1 : (aLength > bLength ? 1 : 0));
+}
+
+int
+InputList::openIndexed(
+        const string &inputFile,
+        int &numParts,
+        uint64_t chunkSize,
+        bool grouped)
+{
+    /* Find the start of every non-blank line of a text list */
+    vector<uint64_t> offsets;
+    if (isPackInput(inputFile)) {
+        if (grouped) {
+            cerr << "Only text lists can be grouped." << endl;
+            return FAILURE;
+        }
+        this->packInput = true;
+        if (!this->pack.open(inputFile.substr(strlen(PackInputPrefix))))
+            return FAILURE;
+        this->numEntries = this->pack.size();
+    } else {
+        if (!mapFile(inputFile, this->listMapping, this->listLength))
+            return FAILURE;
+        const char *text = reinterpret_cast<const char*>(
+                this->listMapping.get());
+        bool blank = true;
+        for (size_t i = 0, lineStart = 0; i < this->listLength; i++) {
+            if (text[i] == '\n') {
+                blank = true;
+                lineStart = i + 1;
+            } else if (blank && !isspace(static_cast<unsigned char>(text[i]))) {
+                blank = false;
+                offsets.push_back(lineStart);
+            }
+        }
+        this->numEntries = offsets.size();
+    }
+    if (this->numEntries == 0) {
+        cerr << "There are no entries in " << inputFile << "." << endl;
+        return FAILURE;
+    }
+
+    /* Sort the entries by their second field, then their first */
+    vector<uint64_t> sorted;
+    vector<EntryFields> keys;
+    if (grouped) {
+        const char *text = reinterpret_cast<const char*>(
+                this->listMapping.get());
+        const char *textEnd = text + this->listLength;
+        keys.resize(this->numEntries);
+        for (uint64_t i = 0; i < this->numEntries; i++) {
+            const char *p = text + offsets[i];
+            if (!nextField(p, textEnd, keys[i].first, keys[i].firstLength) ||
+                    !nextField(p, textEnd, keys[i].second, keys[i].secondLength)) {
+                cerr << "Malformed input entry at byte " << offsets[i] <<
+                        " of " << inputFile << "." << endl;
+                return FAILURE;
+            }
+        }
+        sorted.resize(this->numEntries);
+        for (uint64_t i = 0; i < this->numEntries; i++)
+            sorted[i] = i;
+        stable_sort(sorted.begin(), sorted.end(),
+                [&keys](uint64_t a, uint64_t b) {
+            int cmp = compareFields(keys[a].second, keys[a].secondLength,
+                    keys[b].second, keys[b].secondLength);
+            if (cmp == 0)
+                cmp = compareFields(keys[a].first, keys[a].firstLength,
+                        keys[b].first, keys[b].firstLength);
+            return (cmp < 0);
+        });
+    }
+
+    this->indexed = true;
+    this->chunkSize = chunkSize;
+    if (this->isDynamic()) {
+        this->numChunks = (this->numEntries + chunkSize - 1) / chunkSize;
+        if (this->numChunks < (uint64_t)numParts)
+            numParts = this->numChunks;
+    } else {
+        /*
+         * Divide the sorted entries into numParts near-equal ranges,
+         * moving each boundary forward to where the second field changes
+         */
+        if (this->numEntries < (uint64_t)numParts)
+            numParts = this->numEntries;
+        uint64_t begin{0};
+        for (int i = 0; i < numParts; i++) {
+            uint64_t end = max(begin, this->numEntries * (i + 1) / numParts);
+            while (end > 0 && end < this->numEntries &&
+                    compareFields(keys[sorted[end]].second,
+                    keys[sorted[end]].secondLength,
+                    keys[sorted[end - 1]].second,
+                    keys[sorted[end - 1]].secondLength) == 0)
+                end++;
+            this->ranges.push_back(make_pair(begin, end));
+            begin = end;
+        }
+    }
+
+    /*
+     * Lay out the entry table in memory shared with the workers.  The
+     * counter must be lock-free to work across processes.
+     */
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+            "The work queue needs lock-free 64-bit atomics");
+    size_t length = sizeof(QueueHeader) +
+            this->numEntries * sizeof(EntryRecord) +
+            (offsets.size() + sorted.size()) * sizeof(uint64_t);
+    if (!mapShared(length, this->queueMemory))
+        return FAILURE;
+    uint8_t *p = this->queueMemory.get();
+    this->queueHeader = new (p) QueueHeader();
+    this->queueHeader->nextChunk = 0;
+    p += sizeof(QueueHeader);
+    this->records = reinterpret_cast<EntryRecord*>(p);
+    for (uint64_t i = 0; i < this->numEntries; i++)
+        this->records[i].worker = -1;
+    p += this->numEntries * sizeof(EntryRecord);
+    memcpy(p, offsets.data(), offsets.size() * sizeof(uint64_t));
+    this->entryOffsets = reinterpret_cast<const uint64_t*>(p);
+    p += offsets.size() * sizeof(uint64_t);
+    if (!sorted.empty()) {
+        memcpy(p, sorted.data(), sorted.size() * sizeof(uint64_t));
+        this->order = reinterpret_cast<const uint64_t*>(p);
+    }
+    return SUCCESS;
+}
+
+bool
+InputList::fields(
+        uint64_t i,
+        string &first,
+        string &second) const
+{
+    if (this->isPack()) {
+        first = this->pack.id(i);
+        second = this->pack.path(i);
+        return true;
+    }
+
+    const char *text = reinterpret_cast<const char*>(this->listMapping.get());
+    const char *p = text + this->entryOffsets[i];
+    const char *lineEnd = static_cast<const char*>(memchr(p, '\n',
+            text + this->listLength - p));
+    if (lineEnd == nullptr)
+        lineEnd = text + this->listLength;
+    const char *entry = p;
+    if (!nextField(p, lineEnd, first) || !nextField(p, lineEnd, second)) {
+        cerr << "Malformed input entry: " << string(entry, lineEnd) << endl;
+        return false;
+    }
+    return true;
+}
+
+bool
+InputList::isPack() const
+{
+    return (this->packInput);
+}
+
+bool
+InputList::isDynamic() const
+{
+    return (this->chunkSize > 0);
+}
+
+bool
+InputList::isIndexed() const
+{
+    return (this->indexed);
+}
+
+uint64_t
+InputList::size() const
+{
+    return (this->numEntries);
+}
+
+int
+InputList::restoreLogOrder(const vector<string> &logs) const
+{
+    if (!this->indexed || logs.empty())
+        return SUCCESS;
+
+    /* Map every log and skip past its header */
+    vector<shared_ptr<uint8_t>> mappings(logs.size());
+    vector<const char*> cursors(logs.size()), ends(logs.size());
+    string header;
+    for (size_t w = 0; w < logs.size(); w++) {
+        size_t length;
+        if (!mapFile(logs[w], mappings[w], length))
+            return FAILURE;
+        const char *p = reinterpret_cast<const char*>(mappings[w].get());
+        const char *headerEnd = static_cast<const char*>(memchr(p, '\n', length));
+        if (headerEnd == nullptr) {
+            cerr << "Failed to read the header of " << logs[w] << "." << endl;
+            return FAILURE;
+        }
+        if (w == 0)
+            header.assign(p, headerEnd + 1);
+        cursors[w] = headerEnd + 1;
+        ends[w] = p + length;
+    }
+
+    /*
+     * Find the lines of each processed entry.  Every worker processed its
+     * entries in increasing processing position, so its log can be read
+     * front to back.
+     */
+    vector<pair<const char*, size_t>> spans(this->numEntries,
+            make_pair(nullptr, 0));
+    for (uint64_t pos = 0; pos < this->numEntries; pos++) {
+        const EntryRecord &record = this->records[pos];
+        if (record.worker < 0) {
+            cerr << "Entry " << pos << " was not processed by any worker." <<
+                    endl;
+            return FAILURE;
+        }
+        if ((size_t)record.worker >= logs.size()) {
+            cerr << "Entry " << pos << " was processed by unknown worker " <<
+                    record.worker << "." << endl;
+            return FAILURE;
+        }
+        const char *&cursor = cursors[record.worker];
+        const char *start = cursor;
+        for (uint32_t l = 0; l < record.logLines; l++) {
+            const char *lineEnd = static_cast<const char*>(memchr(cursor,
+                    '\n', ends[record.worker] - cursor));
+            if (lineEnd == nullptr) {
+                cerr << logs[record.worker] << " is missing lines of entry " <<
+                        pos << "." << endl;
+                return FAILURE;
+            }
+            cursor = lineEnd + 1;
+        }
+        spans[pos] = make_pair(start, cursor - start);
+    }
+
+    /* Lines past the last recorded entry belong to an entry cut short */
+    for (size_t w = 0; w < logs.size(); w++) {
+        if (cursors[w] != ends[w]) {
+            cerr << logs[w] << " has lines of no finished entry." << endl;
+            return FAILURE;
+        }
+    }
+
+    /* Position at which each entry of the list was processed */
+    vector<uint64_t> positions;
+    if (this->order != nullptr) {
+        positions.resize(this->numEntries);
+        for (uint64_t pos = 0; pos < this->numEntries; pos++)
+            positions[this->order[pos]] = pos;
+    }
+
+    string merged = logs[0] + ".merge";
+    ofstream mergedStream(merged, ios::binary);
+    if (!mergedStream.is_open()) {
+        cerr << "Failed to open stream for " << merged << "." << endl;
+        return FAILURE;
+    }
+    mergedStream << header;
+    for (uint64_t i = 0; i < this->numEntries; i++) {
+        const auto &span = spans[positions.empty() ? i : positions[i]];
+        mergedStream.write(span.first, span.second);
+    }
+    mergedStream.close();
+    if (!mergedStream) {
+        cerr << "Error writing " << merged << "." << endl;
+        remove(merged.c_str());
+        return FAILURE;
+    }
+
+    mappings.clear();
+    if (rename(merged.c_str(), logs[0].c_str()) != 0) {
+        cerr << "Error renaming " << merged << " to " << logs[0] << "." << endl;
+        return FAILURE;
+    }
+    for (size_t i = 1; i < logs.size(); i++)
+        if (remove(logs[i].c_str()) != 0)
+            cerr << "Error deleting file: " << logs[i] << endl;
+    return SUCCESS;
+}
+
+unique_ptr<InputReader>
+InputList::reader(int part) const
+{
+    if (this->indexed)
+        return (unique_ptr<InputReader>(new IndexedReader(*this, part)));
+
+    if (this->isPack())
+        return (unique_ptr<InputReader>(new PackReader(this->pack,
+                this->ranges[part].first, this->ranges[part].second)));
+
+    const char *text = reinterpret_cast<const char*>(this->listMapping.get());
+    return (unique_ptr<InputReader>(new TextReader(
+            text + this->ranges[part].first, text + this->ranges[part].second)));
+}
@@ -0,0 +1,185 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <time.h>
+
+#include "latency.h"
+#include "util.h"
+
+using namespace std;
+
+const char*
+to_string(TimedCall call)
+{
+    switch (call) {
+    case TimedCall::Initialize: return "initialize";
+    case TimedCall::InitializeEnrollmentSession: return "initializeEnrollmentSession";
+    case TimedCall::InitializeProbeTemplateSession: return "initializeProbeTemplateSession";
+    case TimedCall::InitializeIdentificationSession: return "initializeIdentificationSession";
+    case TimedCall::CreateTemplates: return "createTemplates";
+    case TimedCall::MatchTemplatesBatch: return "matchTemplatesBatch";
+    case TimedCall::IdentifyTemplates: return "identifyTemplates";
+    case TimedCall::FinalizeEnrollment: return "finalizeEnrollment";
+    }
+    return "unknown";
+}
+
+uint64_t
+monotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec);
+}
+
+/** Returns the bucket counting a latency */
+static size_t
+bucketOf(uint64_t ns)
+{
+    if (ns < LatencySubBuckets)
+        return ns;
+    unsigned exponent = 63 - __builtin_clzll(ns);
+    unsigned shift = exponent - LatencySubBucketBits;
+    return ((exponent - LatencySubBucketBits + 1) * LatencySubBuckets +
+            ((ns >> shift) - LatencySubBuckets));
+}
+
+/** Returns the largest latency counted by a bucket */
+static uint64_t
+bucketLimit(size_t bucket)
+{
+    if (bucket < LatencySubBuckets)
+        return bucket;
+    unsigned shift = bucket / LatencySubBuckets - 1;
+    uint64_t first = (LatencySubBuckets + bucket % LatencySubBuckets) << shift;
+    return (first + ((uint64_t)1 << shift) - 1);
+}
+
+void
+LatencyHistogram::record(
+        uint64_t startNs,
+        uint64_t endNs,
+        uint64_t numItems)
+{
+    uint64_t ns = endNs - startNs;
+    if (this->calls == 0 || ns < this->minNs)
+        this->minNs = ns;
+    if (this->calls == 0 || startNs < this->firstStartNs)
+        this->firstStartNs = startNs;
+    this->maxNs = max(this->maxNs, ns);
+    this->lastEndNs = max(this->lastEndNs, endNs);
+    this->calls++;
+    this->items += numItems;
+    this->totalNs += ns;
+    this->buckets[bucketOf(ns)]++;
+}
+
+void
+LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    if (other.calls == 0)
+        return;
+    if (this->calls == 0) {
+        *this = other;
+        return;
+    }
+    this->calls += other.calls;
+    this->items += other.items;
+    this->totalNs += other.totalNs;
+    this->minNs = min(this->minNs, other.minNs);
+    this->maxNs = max(this->maxNs, other.maxNs);
+    this->firstStartNs = min(this->firstStartNs, other.firstStartNs);
+    this->lastEndNs = max(this->lastEndNs, other.lastEndNs);
+    for (size_t i = 0; i < LatencyBuckets; i++)
+        this->buckets[i] += other.buckets[i];
+}
+
+uint64_t
+LatencyHistogram::percentile(double fraction) const
+{
+    if (this->calls == 0)
+        return 0;
+    uint64_t rank = max<uint64_t>(1, (uint64_t)ceil(fraction * this->calls));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LatencyBuckets; i++) {
+        seen += this->buckets[i];
+        if (seen >= rank)
+            return (min(bucketLimit(i), this->maxNs));
+    }
+    return (this->maxNs);
+}
+
+LatencyRecorder::LatencyRecorder() :
+    numWorkers{0},
+    workers{nullptr}
+{}
+
+bool
+LatencyRecorder::create(int numWorkers)
+{
+    /* Worker 0 also holds the calls made before workers start */
+    numWorkers = max(numWorkers, 1);
+    if (!mapShared(numWorkers * sizeof(WorkerLatency), this->memory))
+        return false;
+    this->numWorkers = numWorkers;
+    this->workers = reinterpret_cast<WorkerLatency*>(this->memory.get());
+    return true;
+}
+
+WorkerLatency&
+LatencyRecorder::worker(int i)
+{
+    return (this->workers[i]);
+}
+
+int
+LatencyRecorder::writeSummary(const string &file) const
+{
+    ofstream summary(file);
+    if (!summary.is_open()) {
+        cerr << "Failed to open stream for " << file << "." << endl;
+        return FAILURE;
+    }
+    summary << "call calls items p50us p90us p99us p999us maxus meanus "
+            "itemsPerSecond\n" << fixed << setprecision(1);
+
+    LatencyHistogram merged;
+    for (size_t c = 0; c < NumTimedCalls; c++) {
+        memset(&merged, 0, sizeof(merged));
+        for (int i = 0; i < this->numWorkers; i++)
+            merged.merge(this->workers[i].calls[c]);
+        if (merged.calls == 0)
+            continue;
+
+        double span = (merged.lastEndNs - merged.firstStartNs) / 1e9;
+        summary << to_string(static_cast<TimedCall>(c)) << " "
+                << merged.calls << " "
+                << merged.items << " "
+                << merged.percentile(0.5) / 1e3 << " "
+                << merged.percentile(0.9) / 1e3 << " "
+                << merged.percentile(0.99) / 1e3 << " "
+                << merged.percentile(0.999) / 1e3 << " "
+                << merged.maxNs / 1e3 << " "
+                << merged.totalNs / 1e3 / merged.calls << " "
+                << (span > 0 ? merged.items / span : 0.0) << '\n';
+    }
+
+    summary.close();
+    if (!summary) {
+        cerr << "Error writing " << file << "." << endl;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
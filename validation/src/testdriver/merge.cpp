@@ -0,0 +1,213 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "merge.h"
+#include "util.h"
+
+using namespace std;
+
+string
+shardFile(
+        const string &name,
+        int shard)
+{
+    return (name + "." + to_string(shard));
+}
+
+int
+countShards(const string &name)
+{
+    int numShards = 0;
+    while (access(shardFile(name, numShards).c_str(), F_OK) == 0)
+        numShards++;
+    return numShards;
+}
+
+/**
+ * Appends file, from offset to its end, to outFd.  The copy is done in
+ * the kernel with copy_file_range(2) where the kernel and file systems
+ * allow it, and through a buffer otherwise.
+ */
+static bool
+appendFile(
+        int outFd,
+        const string &file,
+        off_t offset)
+{
+    int inFd = open(file.c_str(), O_RDONLY);
+    struct stat sb;
+    if (inFd == -1 || fstat(inFd, &sb) != 0) {
+        cerr << "Failed to open " << file << ": " << strerror(errno) << endl;
+        if (inFd != -1)
+            close(inFd);
+        return false;
+    }
+
+    bool copied = false;
+#ifdef SYS_copy_file_range
+    loff_t inOffset = offset;
+    while (inOffset < sb.st_size) {
+        ssize_t n = syscall(SYS_copy_file_range, inFd, &inOffset, outFd,
+                nullptr, (size_t)(sb.st_size - inOffset), 0);
+        if (n <= 0)
+            break;
+    }
+    offset = inOffset;
+    copied = (offset >= sb.st_size);
+#endif
+
+    vector<char> buffer(copied ? 0 : 1 << 20);
+    while (!copied) {
+        ssize_t n = pread(inFd, buffer.data(), buffer.size(), offset);
+        if (n == 0)
+            break;
+        if (n < 0 || write(outFd, buffer.data(), n) != n) {
+            cerr << "Error appending " << file << ": " << strerror(errno) << endl;
+            close(inFd);
+            return false;
+        }
+        offset += n;
+    }
+    close(inFd);
+    return true;
+}
+
+int
+mergeLogs(const string &log)
+{
+    const int numShards = countShards(log);
+    if (numShards == 0) {
+        cerr << "There are no shards of " << log << " to merge." << endl;
+        return FAILURE;
+    }
+
+    string header;
+    ifstream firstShard(shardFile(log, 0));
+    if (!getline(firstShard, header)) {
+        cerr << "Failed to read the header of " << shardFile(log, 0) << "." << endl;
+        return FAILURE;
+    }
+    header += '\n';
+
+    string merged = log + ".merge";
+    int fd = open(merged.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || write(fd, header.data(), header.size()) !=
+            (ssize_t)header.size()) {
+        cerr << "Failed to write " << merged << ": " << strerror(errno) << endl;
+        if (fd != -1)
+            close(fd);
+        return FAILURE;
+    }
+
+    /* Copy everything after each shard's header */
+    for (int i = 0; i < numShards; i++) {
+        string shard = shardFile(log, i);
+        ifstream stream(shard);
+        string line;
+        getline(stream, line);
+        off_t bodyOffset = (stream.eof() ? line.size() : line.size() + 1);
+        if (!appendFile(fd, shard, bodyOffset)) {
+            close(fd);
+            remove(merged.c_str());
+            return FAILURE;
+        }
+    }
+    if (close(fd) != 0 || rename(merged.c_str(), log.c_str()) != 0) {
+        cerr << "Error writing " << log << "." << endl;
+        remove(merged.c_str());
+        return FAILURE;
+    }
+
+    for (int i = 0; i < numShards; i++)
+        if (remove(shardFile(log, i).c_str()) != 0)
+            cerr << "Error deleting file: " << shardFile(log, i) << endl;
+    return SUCCESS;
+}
+
+int
+mergeEDBShards(const string &edbDir)
+{
+    const string edb = edbDir + "/edb", manifest = edbDir + "/manifest";
+    const int numShards = countShards(edb);
+    if (numShards == 0) {
+        cerr << "There are no shards of " << edb << " to merge." << endl;
+        return FAILURE;
+    }
+
+    int edbFd = open(edb.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (edbFd == -1) {
+        cerr << "Failed to open " << edb << ": " << strerror(errno) << endl;
+        return FAILURE;
+    }
+    ofstream manifestStream(manifest);
+    if (!manifestStream.is_open()) {
+        cerr << "Failed to open stream for " << manifest << "." << endl;
+        close(edbFd);
+        return FAILURE;
+    }
+
+    /* Append each EDB shard and rebase the offsets of its manifest */
+    uint64_t base = 0;
+    for (int i = 0; i < numShards; i++) {
+        string shardEDB = shardFile(edb, i), shardManifest = shardFile(manifest, i);
+        struct stat sb;
+        ifstream manifestShard(shardManifest);
+        if (stat(shardEDB.c_str(), &sb) != 0 || !manifestShard.is_open()) {
+            cerr << "Failed to open " << shardEDB << " or " << shardManifest <<
+                    "." << endl;
+            close(edbFd);
+            return FAILURE;
+        }
+        if (!appendFile(edbFd, shardEDB, 0)) {
+            close(edbFd);
+            return FAILURE;
+        }
+
+        string id;
+        uint64_t size, offset;
+        while (manifestShard >> id >> size >> offset) {
+            if (offset > (uint64_t)sb.st_size || size > sb.st_size - offset) {
+                cerr << "Template " << id << " of " << shardManifest <<
+                        " lies outside " << shardEDB << "." << endl;
+                close(edbFd);
+                return FAILURE;
+            }
+            manifestStream << id << " " << size << " " << base + offset << "\n";
+        }
+        if (!manifestShard.eof()) {
+            cerr << "Failed to parse " << shardManifest << "." << endl;
+            close(edbFd);
+            return FAILURE;
+        }
+        base += sb.st_size;
+    }
+    manifestStream.close();
+    if (close(edbFd) != 0 || !manifestStream) {
+        cerr << "Error writing " << edb << " or " << manifest << "." << endl;
+        return FAILURE;
+    }
+
+    for (int i = 0; i < numShards; i++) {
+        for (const auto &name : {shardFile(edb, i), shardFile(manifest, i)})
+            if (remove(name.c_str()) != 0)
+                cerr << "Error deleting file: " << name << endl;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,316 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perfcounters.h"
+#include "trace.h"
+#include "util.h"
+
+using namespace std;
+
+const char*
+to_string(Counter counter)
+{
+    switch (counter) {
+    case Counter::Cycles: return "cycles";
+    case Counter::Instructions: return "instructions";
+    case Counter::LLCMisses: return "llcMisses";
+    case Counter::BranchMisses: return "branchMisses";
+    case Counter::DTLBMisses: return "dtlbMisses";
+    }
+    return "unknown";
+}
+
+/** Returns the perf_event_open(2) type and config of a counter */
+static void
+describe(
+        Counter counter,
+        struct perf_event_attr &attr)
+{
+    const uint64_t readMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    switch (counter) {
+    case Counter::Cycles:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case Counter::Instructions:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case Counter::LLCMisses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_LL | readMiss;
+        break;
+    case Counter::BranchMisses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case Counter::DTLBMisses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | readMiss;
+        break;
+    }
+}
+
+PerfCounters::PerfCounters() :
+    numOpen{0}
+{
+    fill(begin(this->fds), end(this->fds), -1);
+    fill(begin(this->positions), end(this->positions), -1);
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int fd : this->fds)
+        if (fd != -1)
+            close(fd);
+}
+
+bool
+PerfCounters::open()
+{
+    /* The first counter that opens leads the group */
+    int leader = -1;
+    for (size_t c = 0; c < NumCounters; c++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        describe(static_cast<Counter>(c), attr);
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        if (fd == -1) {
+            if (this->reason.empty())
+                this->reason = string(to_string(static_cast<Counter>(c))) +
+                        ": " + strerror(errno);
+            continue;
+        }
+        if (leader == -1)
+            leader = fd;
+        this->fds[c] = fd;
+        this->positions[c] = this->numOpen++;
+    }
+    return (this->numOpen > 0);
+}
+
+uint32_t
+PerfCounters::available() const
+{
+    uint32_t mask = 0;
+    for (size_t c = 0; c < NumCounters; c++)
+        if (this->positions[c] != -1)
+            mask |= 1u << c;
+    return mask;
+}
+
+const string&
+PerfCounters::error() const
+{
+    return (this->reason);
+}
+
+bool
+PerfCounters::read(CounterReading &reading) const
+{
+    /* nr, time enabled, time running, then one value per open counter */
+    uint64_t buffer[3 + NumCounters];
+    int leader = -1;
+    for (int fd : this->fds)
+        if (fd != -1) {
+            leader = fd;
+            break;
+        }
+    if (leader == -1)
+        return false;
+
+    size_t length = (3 + this->numOpen) * sizeof(uint64_t);
+    if (::read(leader, buffer, length) != (ssize_t)length)
+        return false;
+    reading.enabledNs = buffer[1];
+    reading.runningNs = buffer[2];
+    for (size_t c = 0; c < NumCounters; c++)
+        reading.values[c] = (this->positions[c] == -1 ? 0 :
+                buffer[3 + this->positions[c]]);
+    return true;
+}
+
+CounterRecorder::CounterRecorder() :
+    numWorkers{0},
+    workers{nullptr}
+{}
+
+bool
+CounterRecorder::create(int numWorkers)
+{
+    /* Say up front what the workers will not be able to count */
+    PerfCounters probe;
+    if (!probe.open())
+        cerr << "Hardware counters are unavailable (" << probe.error() <<
+                "); only calls will be counted." << endl;
+    else if (probe.available() != (1u << NumCounters) - 1)
+        cerr << "Some hardware counters are unavailable (" << probe.error() <<
+                ")." << endl;
+
+    numWorkers = max(numWorkers, 1);
+    if (!mapShared(numWorkers * sizeof(WorkerCounters), this->memory))
+        return false;
+    this->numWorkers = numWorkers;
+    this->workers = reinterpret_cast<WorkerCounters*>(this->memory.get());
+    return true;
+}
+
+WorkerCounters*
+CounterRecorder::worker(int i)
+{
+    return (this->workers == nullptr ? nullptr : &this->workers[i]);
+}
+
+int
+CounterRecorder::writeReport(const string &file) const
+{
+    ofstream report(file);
+    if (!report.is_open()) {
+        cerr << "Failed to open stream for " << file << "." << endl;
+        return FAILURE;
+    }
+    report << "call calls";
+    for (size_t c = 0; c < NumCounters; c++)
+        report << " " << to_string(static_cast<Counter>(c));
+    report << " instructionsPerCycle llcMissesPerCall branchMissesPerCall "
+            "dtlbMissesPerCall\n" << fixed << setprecision(3);
+
+    uint32_t available = 0;
+    for (int i = 0; i < this->numWorkers; i++)
+        available |= this->workers[i].available;
+    auto has = [available](Counter c) -> bool {
+        return ((available & (1u << static_cast<size_t>(c))) != 0); };
+
+    for (size_t t = 0; t < NumTimedCalls; t++) {
+        CounterTotals merged;
+        memset(&merged, 0, sizeof(merged));
+        for (int i = 0; i < this->numWorkers; i++) {
+            merged.calls += this->workers[i].calls[t].calls;
+            for (size_t c = 0; c < NumCounters; c++)
+                merged.values[c] += this->workers[i].calls[t].values[c];
+        }
+        if (merged.calls == 0)
+            continue;
+
+        auto value = [&](Counter c) -> uint64_t {
+            return (merged.values[static_cast<size_t>(c)]); };
+        report << to_string(static_cast<TimedCall>(t)) << " " << merged.calls;
+        for (size_t c = 0; c < NumCounters; c++) {
+            if (has(static_cast<Counter>(c)))
+                report << " " << merged.values[c];
+            else
+                report << " -";
+        }
+        if (has(Counter::Cycles) && has(Counter::Instructions) &&
+                value(Counter::Cycles) > 0)
+            report << " " << (double)value(Counter::Instructions) /
+                    value(Counter::Cycles);
+        else
+            report << " -";
+        for (Counter c : {Counter::LLCMisses, Counter::BranchMisses,
+                Counter::DTLBMisses}) {
+            if (has(c))
+                report << " " << (double)value(c) / merged.calls;
+            else
+                report << " -";
+        }
+        report << '\n';
+    }
+
+    report.close();
+    if (!report) {
+        cerr << "Error writing " << file << "." << endl;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+CallMeter::CallMeter(
+        WorkerLatency &latency,
+        WorkerCounters *counters,
+        WorkerProgress *progress) :
+    latency(latency),
+    counters{counters},
+    progress{progress},
+    startNs{0}
+{
+    memset(&this->before, 0, sizeof(this->before));
+    if (this->counters != nullptr) {
+        this->perf.open();
+        this->counters->available = this->perf.available();
+    }
+}
+
+void
+CallMeter::begin()
+{
+    if (this->counters != nullptr && !this->perf.read(this->before))
+        memset(&this->before, 0, sizeof(this->before));
+    this->startNs = monotonicNs();
+}
+
+void
+CallMeter::end(
+        TimedCall call,
+        uint64_t numItems)
+{
+    uint64_t endNs = monotonicNs();
+    this->latency[call].record(this->startNs, endNs, numItems);
+    traceEvent(to_string(call), this->startNs, endNs, numItems);
+    if (this->progress != nullptr)
+        this->progress->callNs.fetch_add(endNs - this->startNs,
+                memory_order_relaxed);
+    if (this->counters == nullptr)
+        return;
+
+    CounterTotals &totals = (*this->counters)[call];
+    totals.calls++;
+    CounterReading after;
+    if (!this->perf.read(after))
+        return;
+    uint64_t enabled = after.enabledNs - this->before.enabledNs;
+    uint64_t running = after.runningNs - this->before.runningNs;
+    if (running == 0)
+        return;
+    /* Scale up for the time the kernel had the counters switched out */
+    double scale = (double)enabled / running;
+    for (size_t c = 0; c < NumCounters; c++)
+        totals.values[c] += (uint64_t)((after.values[c] - this->before.values[c]) *
+                scale + 0.5);
+}
+
+void
+CallMeter::finished(
+        uint64_t numItems,
+        uint64_t numFailures,
+        uint64_t numBytes)
+{
+    if (this->progress == nullptr)
+        return;
+    this->progress->items.fetch_add(numItems, memory_order_relaxed);
+    this->progress->failures.fetch_add(numFailures, memory_order_relaxed);
+    this->progress->bytes.fetch_add(numBytes, memory_order_relaxed);
+}
@@ -0,0 +1,159 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <algorithm>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+#include "latency.h"
+#include "progress.h"
+#include "util.h"
+
+using namespace std;
+
+/** Writes a number of seconds as h:mm:ss */
+static string
+formatDuration(uint64_t seconds)
+{
+    ostringstream stream;
+    stream << seconds / 3600 << ":" << setfill('0') << setw(2) <<
+            seconds / 60 % 60 << ":" << setw(2) << seconds % 60;
+    return stream.str();
+}
+
+ProgressRecorder::ProgressRecorder() :
+    numWorkers{0},
+    startNs{0},
+    totalItems{0},
+    workers{nullptr},
+    lastNs{0},
+    stopping{false}
+{}
+
+ProgressRecorder::~ProgressRecorder()
+{
+    this->stopReports();
+}
+
+bool
+ProgressRecorder::create(int numWorkers)
+{
+    numWorkers = max(numWorkers, 1);
+    if (!mapShared(numWorkers * sizeof(WorkerProgress), this->memory))
+        return false;
+    this->workers = reinterpret_cast<WorkerProgress*>(this->memory.get());
+    for (int i = 0; i < numWorkers; i++)
+        new (&this->workers[i]) WorkerProgress();
+    this->numWorkers = numWorkers;
+    this->startNs = this->lastNs = monotonicNs();
+    this->lastItems.assign(numWorkers, 0);
+    return true;
+}
+
+WorkerProgress*
+ProgressRecorder::worker(int i)
+{
+    return (this->workers == nullptr ? nullptr : &this->workers[i]);
+}
+
+void
+ProgressRecorder::startReports(
+        int intervalSeconds,
+        uint64_t totalItems)
+{
+    if (this->workers == nullptr || intervalSeconds <= 0 ||
+            this->thread.joinable())
+        return;
+    this->totalItems = totalItems;
+    this->stopping = false;
+    this->thread = std::thread([this, intervalSeconds]() {
+        unique_lock<std::mutex> lock(this->mutex);
+        while (!this->stopped.wait_for(lock, chrono::seconds(intervalSeconds),
+                [this]() { return this->stopping; }))
+            cerr << this->report() << endl;
+    });
+}
+
+void
+ProgressRecorder::stopReports()
+{
+    if (!this->thread.joinable())
+        return;
+    {
+        lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->stopped.notify_one();
+    this->thread.join();
+    cerr << this->report() << endl;
+}
+
+string
+ProgressRecorder::report()
+{
+    const uint64_t nowNs = monotonicNs();
+    uint64_t items = 0, previous = 0, failures = 0, bytes = 0, callNs = 0;
+    uint64_t minItems = UINT64_MAX, maxItems = 0;
+    int slowest = 0, running = 0;
+    string stalled;
+    for (int i = 0; i < this->numWorkers; i++) {
+        const WorkerProgress &worker = this->workers[i];
+        uint64_t done = worker.items.load(memory_order_relaxed);
+        items += done;
+        failures += worker.failures.load(memory_order_relaxed);
+        bytes += worker.bytes.load(memory_order_relaxed);
+        callNs += worker.callNs.load(memory_order_relaxed);
+        if (done < minItems) {
+            minItems = done;
+            slowest = i;
+        }
+        maxItems = max(maxItems, done);
+
+        /* A worker that is still running but finished nothing may be stuck */
+        if (worker.finished.load(memory_order_relaxed) == 0) {
+            running++;
+            if (this->lastNs != this->startNs && done == this->lastItems[i])
+                stalled += " " + to_string(i);
+        }
+        previous += this->lastItems[i];
+        this->lastItems[i] = done;
+    }
+
+    const double elapsed = max<uint64_t>(1, nowNs - this->startNs) / 1e9;
+    const double interval = max<uint64_t>(1, nowNs - this->lastNs) / 1e9;
+    const double rate = items / elapsed;
+
+    ostringstream line;
+    line << fixed << setprecision(1) << "Progress: " << items;
+    if (this->totalItems > 0)
+        line << "/" << this->totalItems << " items (" <<
+                100.0 * items / this->totalItems << "%)";
+    else
+        line << " items";
+    line << ", " << rate << " items/s";
+    if (this->lastNs != this->startNs)
+        line << " (" << (items - previous) / interval << " recent)";
+    if (this->totalItems > items && rate > 0)
+        line << ", ETA " << formatDuration((this->totalItems - items) / rate);
+    line << ", " << failures << " failed, " << bytes / 1048576.0 <<
+            " MiB written, " << 100.0 * callNs / (elapsed * 1e9 * this->numWorkers) <<
+            "% of worker time in calls, " << running << "/" << this->numWorkers <<
+            " workers running";
+    if (this->numWorkers > 1 && items > 0)
+        line << "; items per worker " << minItems << " (worker " << slowest <<
+                ") to " << maxItems << ", skew " <<
+                100.0 * (maxItems - minItems) * this->numWorkers / items << "%";
+    if (!stalled.empty())
+        line << "; no progress from worker" << stalled;
+
+    this->lastNs = nowNs;
+    return line.str();
+}
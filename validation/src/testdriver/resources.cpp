@@ -0,0 +1,187 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "latency.h"
+#include "resources.h"
+#include "util.h"
+
+using namespace std;
+
+/**
+ * Adds up the memory fields of /proc/self/smaps_rollup, or of every
+ * mapping in /proc/self/smaps on kernels without it.  Returns false if
+ * neither can be read.
+ */
+static bool
+readMemory(ResourceSample &sample)
+{
+    ifstream smaps("/proc/self/smaps_rollup");
+    if (!smaps.is_open())
+        smaps.open("/proc/self/smaps");
+    if (!smaps.is_open())
+        return false;
+
+    const struct {
+        const char *field;
+        int64_t ResourceSample::*value;
+    } fields[] = {
+        {"Rss:", &ResourceSample::rssKiB},
+        {"Pss:", &ResourceSample::pssKiB},
+        {"Shared_Clean:", &ResourceSample::sharedCleanKiB},
+        {"Shared_Dirty:", &ResourceSample::sharedDirtyKiB},
+        {"Private_Clean:", &ResourceSample::privateCleanKiB},
+        {"Private_Dirty:", &ResourceSample::privateDirtyKiB},
+        {"Swap:", &ResourceSample::swapKiB}
+    };
+    for (const auto &f : fields)
+        sample.*f.value = 0;
+
+    string field;
+    int64_t kiB;
+    while (smaps >> field) {
+        for (const auto &f : fields) {
+            if (field == f.field && smaps >> kiB) {
+                sample.*f.value += kiB;
+                break;
+            }
+        }
+        smaps.ignore(numeric_limits<streamsize>::max(), '\n');
+    }
+    return true;
+}
+
+ResourceRecorder::ResourceRecorder() :
+    numWorkers{0},
+    startNs{0},
+    owners{nullptr}
+{}
+
+bool
+ResourceRecorder::create(int numWorkers)
+{
+    numWorkers = max(numWorkers, 0);
+    if (!mapShared((numWorkers + 1) * sizeof(Samples), this->memory))
+        return false;
+    this->numWorkers = numWorkers;
+    this->startNs = monotonicNs();
+    this->owners = reinterpret_cast<Samples*>(this->memory.get());
+    return true;
+}
+
+void
+ResourceRecorder::sample(
+        int worker,
+        const char *phase,
+        ResourceScope scope)
+{
+    if (worker < -1 || worker >= this->numWorkers)
+        return;
+    Samples &owner = this->owners[worker + 1];
+    if (owner.count == ResourceSamplesPerWorker)
+        return;
+
+    ResourceSample &sample = owner.samples[owner.count++];
+    memset(&sample, 0, sizeof(sample));
+    strncpy(sample.phase, phase, sizeof(sample.phase) - 1);
+    sample.worker = worker;
+    sample.pid = getpid();
+    sample.elapsedNs = monotonicNs() - this->startNs;
+
+    struct rusage usage;
+    int who = (scope == ResourceScope::Thread ? RUSAGE_THREAD :
+            scope == ResourceScope::Children ? RUSAGE_CHILDREN : RUSAGE_SELF);
+    if (getrusage(who, &usage) == 0) {
+        sample.userUs = usage.ru_utime.tv_sec * 1000000 + usage.ru_utime.tv_usec;
+        sample.systemUs = usage.ru_stime.tv_sec * 1000000 + usage.ru_stime.tv_usec;
+        sample.maxRssKiB = usage.ru_maxrss;
+        sample.minorFaults = usage.ru_minflt;
+        sample.majorFaults = usage.ru_majflt;
+        sample.voluntarySwitches = usage.ru_nvcsw;
+        sample.involuntarySwitches = usage.ru_nivcsw;
+    }
+
+    if (scope == ResourceScope::Children || !readMemory(sample)) {
+        sample.rssKiB = sample.pssKiB = sample.sharedCleanKiB =
+                sample.sharedDirtyKiB = sample.privateCleanKiB =
+                sample.privateDirtyKiB = sample.swapKiB = -1;
+    }
+}
+
+bool
+ResourceRecorder::find(
+        int worker,
+        const string &phase,
+        ResourceSample &sample) const
+{
+    if (worker < -1 || worker >= this->numWorkers)
+        return false;
+    const Samples &owner = this->owners[worker + 1];
+    for (uint32_t s = 0; s < owner.count; s++) {
+        if (phase == owner.samples[s].phase) {
+            sample = owner.samples[s];
+            return true;
+        }
+    }
+    return false;
+}
+
+int
+ResourceRecorder::writeReport(const string &file) const
+{
+    ofstream report(file);
+    if (!report.is_open()) {
+        cerr << "Failed to open stream for " << file << "." << endl;
+        return FAILURE;
+    }
+    report << "phase worker pid elapsedSeconds userSeconds systemSeconds "
+            "maxRssKiB minorFaults majorFaults voluntarySwitches "
+            "involuntarySwitches rssKiB pssKiB sharedCleanKiB sharedDirtyKiB "
+            "privateCleanKiB privateDirtyKiB swapKiB\n" << fixed << setprecision(6);
+
+    for (int i = 0; i <= this->numWorkers; i++) {
+        const Samples &owner = this->owners[i];
+        for (uint32_t s = 0; s < owner.count; s++) {
+            const ResourceSample &sample = owner.samples[s];
+            report << sample.phase << " "
+                    << sample.worker << " "
+                    << sample.pid << " "
+                    << sample.elapsedNs / 1e9 << " "
+                    << sample.userUs / 1e6 << " "
+                    << sample.systemUs / 1e6 << " "
+                    << sample.maxRssKiB << " "
+                    << sample.minorFaults << " "
+                    << sample.majorFaults << " "
+                    << sample.voluntarySwitches << " "
+                    << sample.involuntarySwitches << " "
+                    << sample.rssKiB << " "
+                    << sample.pssKiB << " "
+                    << sample.sharedCleanKiB << " "
+                    << sample.sharedDirtyKiB << " "
+                    << sample.privateCleanKiB << " "
+                    << sample.privateDirtyKiB << " "
+                    << sample.swapKiB << '\n';
+        }
+    }
+
+    report.close();
+    if (!report) {
+        cerr << "Error writing " << file << "." << endl;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,187 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "scorematrix.h"
+#include "util.h"
+
+using namespace std;
+using namespace FRPC;
+
+ScoreMatrix::ScoreMatrix() :
+    length{0},
+    header{nullptr},
+    scores{nullptr},
+    codes{nullptr}
+{}
+
+bool
+ScoreMatrix::create(
+        const string &file,
+        const vector<string> &rowNames,
+        const vector<string> &colNames)
+{
+    const uint64_t rows = rowNames.size(), cols = colNames.size();
+    string names;
+    for (const auto &name : rowNames)
+        names += name + '\n';
+    for (const auto &name : colNames)
+        names += name + '\n';
+
+    ScoreMatrixHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, ScoreMatrixMagic, sizeof(ScoreMatrixMagic));
+    h.version = ScoreMatrixVersion;
+    h.rows = rows;
+    h.cols = cols;
+    h.scoresOffset = sizeof(ScoreMatrixHeader);
+    h.codesOffset = h.scoresOffset + rows * cols * sizeof(double);
+    h.namesOffset = h.codesOffset + rows * cols;
+    size_t fileLength = h.namesOffset + names.size();
+
+    int fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        cerr << "Failed to create " << file << ": " << strerror(errno) << endl;
+        return false;
+    }
+    if (ftruncate(fd, fileLength) != 0) {
+        cerr << "Failed to size " << file << ": " << strerror(errno) << endl;
+        close(fd);
+        return false;
+    }
+    void *addr = mmap(nullptr, fileLength, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        cerr << "Error mapping " << file << ": " << strerror(errno) << endl;
+        return false;
+    }
+    this->length = fileLength;
+    this->mapping.reset(static_cast<uint8_t*>(addr),
+            [fileLength](uint8_t *p) { munmap(p, fileLength); });
+
+    memcpy(this->mapping.get(), &h, sizeof(h));
+    this->header = reinterpret_cast<const ScoreMatrixHeader*>(this->mapping.get());
+    this->scores = reinterpret_cast<double*>(this->mapping.get() + h.scoresOffset);
+    this->codes = this->mapping.get() + h.codesOffset;
+    memset(this->codes, ScoreMatrixNotComputed, rows * cols);
+    memcpy(this->mapping.get() + h.namesOffset, names.data(), names.size());
+    this->rowNames = rowNames;
+    this->colNames = colNames;
+    return true;
+}
+
+bool
+ScoreMatrix::open(const string &file)
+{
+    if (!mapFile(file, this->mapping, this->length))
+        return false;
+
+    this->header = reinterpret_cast<const ScoreMatrixHeader*>(this->mapping.get());
+    if (this->length < sizeof(ScoreMatrixHeader) ||
+            memcmp(this->header->magic, ScoreMatrixMagic, sizeof(ScoreMatrixMagic)) != 0 ||
+            this->header->version != ScoreMatrixVersion) {
+        cerr << file << " is not a version " << ScoreMatrixVersion <<
+                " score matrix." << endl;
+        return false;
+    }
+    const uint64_t cells = this->header->rows * this->header->cols;
+    if (this->header->scoresOffset != sizeof(ScoreMatrixHeader) ||
+            this->header->codesOffset != this->header->scoresOffset +
+            cells * sizeof(double) ||
+            this->header->namesOffset != this->header->codesOffset + cells ||
+            this->length < this->header->namesOffset) {
+        cerr << "The score matrix " << file << " is truncated." << endl;
+        return false;
+    }
+    this->scores = reinterpret_cast<double*>(
+            this->mapping.get() + this->header->scoresOffset);
+    this->codes = this->mapping.get() + this->header->codesOffset;
+
+    /* One name per line, rows first */
+    const char *p = reinterpret_cast<const char*>(this->mapping.get()) +
+            this->header->namesOffset;
+    const char *end = reinterpret_cast<const char*>(this->mapping.get()) +
+            this->length;
+    this->rowNames.clear();
+    this->colNames.clear();
+    while (p < end && this->colNames.size() < this->header->cols) {
+        const char *lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (lineEnd == nullptr)
+            break;
+        (this->rowNames.size() < this->header->rows ? this->rowNames :
+                this->colNames).emplace_back(p, lineEnd);
+        p = lineEnd + 1;
+    }
+    if (this->rowNames.size() != this->header->rows ||
+            this->colNames.size() != this->header->cols) {
+        cerr << "The score matrix " << file << " is missing template names." <<
+                endl;
+        return false;
+    }
+    return true;
+}
+
+uint64_t
+ScoreMatrix::rows() const
+{
+    return (this->header == nullptr ? 0 : this->header->rows);
+}
+
+uint64_t
+ScoreMatrix::cols() const
+{
+    return (this->header == nullptr ? 0 : this->header->cols);
+}
+
+const string&
+ScoreMatrix::rowName(uint64_t row) const
+{
+    return (this->rowNames[row]);
+}
+
+const string&
+ScoreMatrix::colName(uint64_t col) const
+{
+    return (this->colNames[col]);
+}
+
+void
+ScoreMatrix::set(
+        uint64_t row,
+        uint64_t col,
+        double score,
+        ReturnCode code)
+{
+    uint64_t cell = row * this->header->cols + col;
+    this->scores[cell] = score;
+    this->codes[cell] = static_cast<uint8_t>(code);
+}
+
+double
+ScoreMatrix::score(
+        uint64_t row,
+        uint64_t col) const
+{
+    return (this->scores[row * this->header->cols + col]);
+}
+
+uint8_t
+ScoreMatrix::code(
+        uint64_t row,
+        uint64_t col) const
+{
+    return (this->codes[row * this->header->cols + col]);
+}
@@ -0,0 +1,298 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "sharededb.h"
+#include "trace.h"
+#include "util.h"
+
+using namespace std;
+
+SharedEDB::SharedEDB() :
+    edbFd{-1},
+    manifestFd{-1},
+    nextOffset{nullptr},
+    nextManifestOffset{nullptr}
+{}
+
+SharedEDB::~SharedEDB()
+{
+    if (this->edbFd != -1)
+        close(this->edbFd);
+    if (this->manifestFd != -1)
+        close(this->manifestFd);
+}
+
+bool
+SharedEDB::create(
+        const string &edb,
+        const string &manifest)
+{
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+            "The EDB and manifest offsets need lock-free 64-bit atomics");
+
+    this->edbFile = edb;
+    this->edbFd = ::open(edb.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (this->edbFd == -1) {
+        cerr << "Failed to open " << edb << ": " << strerror(errno) << endl;
+        return false;
+    }
+    this->manifestFd = ::open(manifest.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (this->manifestFd == -1) {
+        cerr << "Failed to open " << manifest << ": " << strerror(errno) << endl;
+        return false;
+    }
+
+    if (!mapShared(2 * sizeof(atomic<uint64_t>), this->counterMemory))
+        return false;
+    this->nextOffset = new (this->counterMemory.get()) atomic<uint64_t>(0);
+    this->nextManifestOffset = new (this->nextOffset + 1) atomic<uint64_t>(0);
+    return true;
+}
+
+bool
+SharedEDB::add(
+        const vector<string> &ids,
+        const vector<vector<uint8_t>> &templs)
+{
+    TraceSpan span("writeEDB");
+    span.setItems(templs.size());
+
+    /* Reserve one range of the EDB for the whole batch */
+    uint64_t total = 0;
+    for (const auto &templ : templs)
+        total += templ.size();
+    uint64_t offset = this->nextOffset->fetch_add(total);
+
+    /* Write the batch's templates back to back, with as few calls as possible */
+    string lines;
+    vector<struct iovec> iov;
+    uint64_t templOffset = offset;
+    for (size_t i = 0; i < templs.size(); i++) {
+        lines += ids[i] + " " + to_string(templs[i].size()) + " " +
+                to_string(templOffset) + "\n";
+        templOffset += templs[i].size();
+        if (!templs[i].empty())
+            iov.push_back({(void*)templs[i].data(), templs[i].size()});
+    }
+    for (size_t first = 0; first < iov.size(); ) {
+        ssize_t n = pwritev(this->edbFd, &iov[first],
+                min<size_t>(iov.size() - first, IOV_MAX), offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            cerr << "Error writing " << this->edbFile << ": " <<
+                    strerror(errno) << endl;
+            return false;
+        }
+        /* Skip what was written, which may end partway through a template */
+        offset += n;
+        for (; first < iov.size() && (size_t)n >= iov[first].iov_len; first++)
+            n -= iov[first].iov_len;
+        if (n > 0) {
+            iov[first].iov_base = (uint8_t*)iov[first].iov_base + n;
+            iov[first].iov_len -= n;
+        }
+    }
+
+    /* Likewise reserve a range of the manifest for the batch's lines */
+    return (this->writeManifest(lines, this->reserveManifest(lines.size())));
+}
+
+uint64_t
+SharedEDB::reserveEDB(uint64_t length)
+{
+    return (this->nextOffset->fetch_add(length));
+}
+
+uint64_t
+SharedEDB::reserveManifest(uint64_t length)
+{
+    return (this->nextManifestOffset->fetch_add(length));
+}
+
+/** Writes all of data at offset of fd, returning whether it succeeded */
+static bool
+writeAt(
+        int fd,
+        const char *data,
+        size_t length,
+        uint64_t offset)
+{
+    for (size_t written = 0; written < length; ) {
+        ssize_t n = pwrite(fd, data + written, length - written,
+                offset + written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        written += n;
+    }
+    return true;
+}
+
+bool
+SharedEDB::writeEDB(
+        const uint8_t *data,
+        size_t length,
+        uint64_t offset)
+{
+    if (!writeAt(this->edbFd, reinterpret_cast<const char*>(data), length,
+            offset)) {
+        cerr << "Error writing " << this->edbFile << ": " << strerror(errno) <<
+                endl;
+        return false;
+    }
+    return true;
+}
+
+bool
+SharedEDB::writeManifest(
+        const string &lines,
+        uint64_t offset)
+{
+    if (!writeAt(this->manifestFd, lines.data(), lines.size(), offset)) {
+        cerr << "Error writing the manifest of " << this->edbFile << ": " <<
+                strerror(errno) << endl;
+        return false;
+    }
+    return true;
+}
+
+EDBWriter::EDBWriter(SharedEDB &edb) :
+    edb(edb),
+    batches(EDBWriterBatches),
+    current{0},
+    stopping{false},
+    failed{false}
+{
+    for (size_t i = 1; i < EDBWriterBatches; i++)
+        this->freeBatches.push_back(i);
+    this->batches[0].templates.reserve(EDBWriterBufferSize);
+    this->thread = std::thread(&EDBWriter::writeBehind, this);
+}
+
+EDBWriter::~EDBWriter()
+{
+    this->close();
+}
+
+bool
+EDBWriter::add(
+        const vector<string> &ids,
+        const vector<vector<uint8_t>> &templs)
+{
+    for (size_t i = 0; i < templs.size(); i++) {
+        Batch &batch = this->batches[this->current];
+        batch.templates.insert(batch.templates.end(), templs[i].begin(),
+                templs[i].end());
+        batch.ids.push_back(ids[i]);
+        batch.sizes.push_back(templs[i].size());
+        if (batch.templates.size() >= EDBWriterBufferSize ||
+                batch.ids.size() >= EDBWriterMaxTemplates)
+            this->handOff();
+    }
+    lock_guard<std::mutex> lock(this->mutex);
+    return (!this->failed);
+}
+
+void
+EDBWriter::handOff()
+{
+    Batch &batch = this->batches[this->current];
+    if (!batch.ids.empty()) {
+        /* Manifest lines hold EDB offsets, so the EDB range comes first */
+        batch.edbOffset = this->edb.reserveEDB(batch.templates.size());
+        batch.lines.clear();
+        uint64_t offset = batch.edbOffset;
+        for (size_t i = 0; i < batch.ids.size(); i++) {
+            batch.lines += batch.ids[i] + " " +
+                    to_string(batch.sizes[i]) + " " + to_string(offset) + "\n";
+            offset += batch.sizes[i];
+        }
+        batch.manifestOffset = this->edb.reserveManifest(batch.lines.size());
+
+        lock_guard<std::mutex> lock(this->mutex);
+        this->fullBatches.push_back(this->current);
+    }
+    this->queued.notify_one();
+
+    unique_lock<std::mutex> lock(this->mutex);
+    this->released.wait(lock, [this]() {
+        return (!this->freeBatches.empty()); });
+    this->current = this->freeBatches.front();
+    this->freeBatches.pop_front();
+}
+
+bool
+EDBWriter::close()
+{
+    if (!this->thread.joinable())
+        return (!this->failed);
+
+    this->handOff();
+    {
+        lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->queued.notify_one();
+    this->thread.join();
+    return (!this->failed);
+}
+
+void
+EDBWriter::writeBehind()
+{
+    traceThread("EDB writer");
+    while (true) {
+        size_t index;
+        {
+            unique_lock<std::mutex> lock(this->mutex);
+            this->queued.wait(lock, [this]() {
+                return (this->stopping || !this->fullBatches.empty()); });
+            if (this->fullBatches.empty())
+                return;
+            index = this->fullBatches.front();
+            this->fullBatches.pop_front();
+        }
+
+        /* After a failure, keep releasing batches so the worker never blocks */
+        Batch &batch = this->batches[index];
+        if (!this->failed) {
+            TraceSpan span("writeEDB");
+            span.setItems(batch.ids.size());
+            if (!this->edb.writeEDB(batch.templates.data(),
+                    batch.templates.size(), batch.edbOffset) ||
+                    !this->edb.writeManifest(batch.lines,
+                    batch.manifestOffset)) {
+                lock_guard<std::mutex> lock(this->mutex);
+                this->failed = true;
+            }
+        }
+        batch.templates.clear();
+        batch.ids.clear();
+        batch.sizes.clear();
+
+        {
+            lock_guard<std::mutex> lock(this->mutex);
+            this->freeBatches.push_back(index);
+        }
+        this->released.notify_one();
+    }
+}
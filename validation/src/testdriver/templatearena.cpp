@@ -0,0 +1,128 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <sys/stat.h>
+
+#include "input.h"
+#include "templatearena.h"
+#include "util.h"
+
+using namespace std;
+using namespace FRPC;
+
+TemplateArena::TemplateArena() :
+    length{0}
+{}
+
+int
+TemplateArena::load(
+        const vector<string> &keys,
+        const string &templatesDir,
+        const TemplateStore *store)
+{
+    /* Collect the distinct templates in order of first use, with sizes */
+    vector<pair<string, uint64_t>> templates;
+    for (const auto &key : keys) {
+        if (this->index.count(key) != 0)
+            continue;
+
+        uint64_t size;
+        if (store != nullptr) {
+            const TemplateIndexEntry *e = store->find(key);
+            if (e == nullptr) {
+                cerr << "There is no template " << key << " in the "
+                        "template store in " << templatesDir << "." << endl;
+                return FAILURE;
+            }
+            size = e->size;
+        } else {
+            struct stat sb;
+            string file = templatesDir + "/" + key;
+            if (stat(file.c_str(), &sb) != 0) {
+                cerr << "Unable to retrieve template from file : " <<
+                        file << endl;
+                return FAILURE;
+            }
+            size = sb.st_size;
+        }
+        this->index[key] = TemplateView();
+        templates.push_back(make_pair(key, size));
+    }
+
+    /* Lay the templates out back to back on aligned boundaries */
+    this->length = 0;
+    for (const auto &t : templates)
+        this->length += (t.second + TemplateArenaAlignment - 1) /
+                TemplateArenaAlignment * TemplateArenaAlignment;
+    if (this->length > 0 && !mapShared(this->length, this->memory))
+        return FAILURE;
+
+    uint8_t *p = this->memory.get();
+    for (const auto &t : templates) {
+        if (store != nullptr) {
+            memcpy(p, store->data(*store->find(t.first)), t.second);
+        } else {
+            string file = templatesDir + "/" + t.first;
+            ifstream stream(file, ios::binary);
+            if (!stream.read((char*)p, t.second)) {
+                cerr << "Unable to retrieve template from file : " <<
+                        file << endl;
+                return FAILURE;
+            }
+        }
+        this->index[t.first] = TemplateView(p, t.second);
+        p += (t.second + TemplateArenaAlignment - 1) /
+                TemplateArenaAlignment * TemplateArenaAlignment;
+    }
+    return SUCCESS;
+}
+
+int
+TemplateArena::loadMatchList(
+        const string &matchList,
+        const string &templatesDir,
+        const TemplateStore *store)
+{
+    shared_ptr<uint8_t> listMapping;
+    size_t listLength;
+    if (!mapFile(matchList, listMapping, listLength))
+        return FAILURE;
+
+    vector<string> keys;
+    const char *text = reinterpret_cast<const char*>(listMapping.get());
+    TextReader reader(text, text + listLength);
+    string enrollKey, verifKey;
+    while (reader.next(enrollKey, verifKey)) {
+        keys.push_back(enrollKey);
+        keys.push_back(verifKey);
+    }
+    return (this->load(keys, templatesDir, store));
+}
+
+bool
+TemplateArena::find(
+        const string &key,
+        TemplateView &view) const
+{
+    auto it = this->index.find(key);
+    if (it == this->index.end())
+        return false;
+    view = it->second;
+    return true;
+}
+
+size_t
+TemplateArena::size() const
+{
+    return (this->length);
+}
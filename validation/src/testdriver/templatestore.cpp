@@ -0,0 +1,351 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+
+#include "templatestore.h"
+#include "util.h"
+
+using namespace std;
+
+/** Returns the file name of a store file, or of shard i of it */
+static string
+storeFile(
+        const string &templatesDir,
+        const char *name,
+        int shard = -1)
+{
+    string file = templatesDir + "/" + name;
+    if (shard >= 0)
+        file += "." + to_string(shard);
+    return file;
+}
+
+/** 64-bit FNV-1a hash of a NUL-terminated key */
+static uint64_t
+hashKey(const char *key)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *key != '\0'; key++) {
+        hash ^= static_cast<uint8_t>(*key);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool
+validHeader(
+        const TemplateIndexHeader &header,
+        const string &file)
+{
+    if (memcmp(header.magic, TemplateIndexMagic, sizeof(TemplateIndexMagic)) != 0 ||
+            header.version != TemplateIndexVersion ||
+            header.entrySize != sizeof(TemplateIndexEntry)) {
+        cerr << file << " is not a version " << TemplateIndexVersion <<
+                " template store index." << endl;
+        return false;
+    }
+    return true;
+}
+
+/** Reads the header and entries, but not the hash slots, of an index */
+static bool
+readIndex(
+        const string &file,
+        TemplateIndexHeader &header,
+        vector<TemplateIndexEntry> &entries)
+{
+    ifstream stream(file, ios::binary);
+    if (!stream.is_open()) {
+        cerr << "Failed to open stream for " << file << "." << endl;
+        return false;
+    }
+    if (!stream.read((char*)&header, sizeof(header)) || !validHeader(header, file))
+        return false;
+
+    size_t first = entries.size();
+    entries.resize(first + header.count);
+    if (!stream.read((char*)(entries.data() + first),
+            header.count * sizeof(TemplateIndexEntry))) {
+        cerr << "The index " << file << " is truncated." << endl;
+        return false;
+    }
+    return true;
+}
+
+static void
+initHeader(TemplateIndexHeader &header)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TemplateIndexMagic, sizeof(TemplateIndexMagic));
+    header.version = TemplateIndexVersion;
+    header.entrySize = sizeof(TemplateIndexEntry);
+}
+
+TemplateStoreWriter::TemplateStoreWriter() :
+    dataSize{0}
+{}
+
+bool
+TemplateStoreWriter::open(
+        const string &templatesDir,
+        int shard)
+{
+    string dataFile = storeFile(templatesDir, TemplateStoreData, shard);
+    this->indexFile = storeFile(templatesDir, TemplateStoreIndex, shard);
+    this->dataStream.open(dataFile, ios::binary);
+    if (!this->dataStream.is_open()) {
+        cerr << "Failed to open stream for " << dataFile << "." << endl;
+        return false;
+    }
+    return true;
+}
+
+bool
+TemplateStoreWriter::add(
+        const string &key,
+        const vector<uint8_t> &templ)
+{
+    TemplateIndexEntry e;
+    memset(&e, 0, sizeof(e));
+    if (key.size() >= sizeof(e.key)) {
+        cerr << "Key too long for a template store: " << key << endl;
+        return false;
+    }
+    memcpy(e.key, key.c_str(), key.size());
+    e.offset = this->dataSize;
+    e.size = templ.size();
+
+    this->dataStream.write((const char*)templ.data(), templ.size());
+    this->dataSize += templ.size();
+    this->entries.push_back(e);
+    return (this->dataStream.good());
+}
+
+bool
+TemplateStoreWriter::close()
+{
+    this->dataStream.close();
+    if (!this->dataStream) {
+        cerr << "Error writing the data of " << this->indexFile << "." << endl;
+        return false;
+    }
+
+    TemplateIndexHeader header;
+    initHeader(header);
+    header.count = this->entries.size();
+    header.dataSize = this->dataSize;
+
+    ofstream indexStream(this->indexFile, ios::binary);
+    indexStream.write((const char*)&header, sizeof(header));
+    indexStream.write((const char*)this->entries.data(),
+            this->entries.size() * sizeof(TemplateIndexEntry));
+    if (!indexStream.good()) {
+        cerr << "Error writing " << this->indexFile << "." << endl;
+        return false;
+    }
+    return true;
+}
+
+TemplateStore::TemplateStore() :
+    indexLength{0},
+    dataLength{0},
+    header{nullptr},
+    entries{nullptr},
+    slots{nullptr}
+{}
+
+bool
+TemplateStore::open(const string &templatesDir)
+{
+    string indexFile = storeFile(templatesDir, TemplateStoreIndex);
+    string dataFile = storeFile(templatesDir, TemplateStoreData);
+    if (!mapFile(indexFile, this->indexMapping, this->indexLength))
+        return false;
+
+    this->header = reinterpret_cast<const TemplateIndexHeader*>(
+            this->indexMapping.get());
+    if (this->indexLength < sizeof(TemplateIndexHeader) ||
+            !validHeader(*this->header, indexFile))
+        return false;
+    const uint64_t count = this->header->count;
+    const uint64_t numSlots = this->header->numSlots;
+    if ((numSlots & (numSlots - 1)) != 0 || numSlots < count ||
+            (this->indexLength - sizeof(TemplateIndexHeader)) / sizeof(uint64_t) <
+            count * (sizeof(TemplateIndexEntry) / sizeof(uint64_t)) + numSlots) {
+        cerr << "The index " << indexFile << " is truncated or has no "
+                "hash table." << endl;
+        return false;
+    }
+    this->entries = reinterpret_cast<const TemplateIndexEntry*>(
+            this->indexMapping.get() + sizeof(TemplateIndexHeader));
+    this->slots = reinterpret_cast<const uint64_t*>(this->entries + count);
+
+    if (this->header->dataSize > 0) {
+        if (!mapFile(dataFile, this->dataMapping, this->dataLength))
+            return false;
+        if (this->dataLength < this->header->dataSize) {
+            cerr << dataFile << " is truncated." << endl;
+            return false;
+        }
+        /* Comparisons visit templates in list order, not file order */
+        madvise(this->dataMapping.get(), this->dataLength, MADV_RANDOM);
+    }
+
+    for (uint64_t i = 0; i < count; i++) {
+        const TemplateIndexEntry &e = this->entries[i];
+        if (e.offset > this->header->dataSize ||
+                e.size > this->header->dataSize - e.offset ||
+                memchr(e.key, '\0', sizeof(e.key)) == nullptr) {
+            cerr << "Entry " << i << " of " << indexFile << " is corrupt." << endl;
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < numSlots; i++) {
+        if (this->slots[i] > count) {
+            cerr << "Hash slot " << i << " of " << indexFile << " is corrupt." << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+const TemplateIndexEntry*
+TemplateStore::find(const string &key) const
+{
+    if (this->header == nullptr || this->header->numSlots == 0)
+        return nullptr;
+
+    const uint64_t mask = this->header->numSlots - 1;
+    for (uint64_t h = hashKey(key.c_str()) & mask; this->slots[h] != 0;
+            h = (h + 1) & mask) {
+        const TemplateIndexEntry &e = this->entries[this->slots[h] - 1];
+        if (key == e.key)
+            return &e;
+    }
+    return nullptr;
+}
+
+const uint8_t*
+TemplateStore::data(const TemplateIndexEntry &entry) const
+{
+    return (this->dataMapping.get() + entry.offset);
+}
+
+bool
+TemplateStore::read(
+        const string &key,
+        vector<uint8_t> &templ) const
+{
+    const TemplateIndexEntry *e = this->find(key);
+    if (e == nullptr)
+        return false;
+    const uint8_t *p = this->data(*e);
+    templ.assign(p, p + e->size);
+    return true;
+}
+
+int
+mergeTemplateStore(
+        const string &templatesDir,
+        int numShards)
+{
+    string dataFile = storeFile(templatesDir, TemplateStoreData);
+    string indexFile = storeFile(templatesDir, TemplateStoreIndex);
+
+    /* Start from the existing store, if any */
+    TemplateIndexHeader header;
+    initHeader(header);
+    vector<TemplateIndexEntry> entries;
+    if (ifstream(indexFile) && !readIndex(indexFile, header, entries))
+        return FAILURE;
+    header.numSlots = 0;
+
+    ofstream dataStream(dataFile, ios::binary | ios::app);
+    if (!dataStream.is_open()) {
+        cerr << "Failed to open stream for " << dataFile << "." << endl;
+        return FAILURE;
+    }
+    dataStream.seekp(0, ios::end);
+    if ((uint64_t)dataStream.tellp() != header.dataSize) {
+        cerr << dataFile << " does not match " << indexFile << "." << endl;
+        return FAILURE;
+    }
+
+    /* Append each shard's data, rebasing the offsets of its entries */
+    auto exitStatus = SUCCESS;
+    vector<string> merged;
+    for (int i = 0; i < numShards; i++) {
+        string shardData = storeFile(templatesDir, TemplateStoreData, i);
+        string shardIndex = storeFile(templatesDir, TemplateStoreIndex, i);
+        TemplateIndexHeader shardHeader;
+        size_t first = entries.size();
+        if (!readIndex(shardIndex, shardHeader, entries)) {
+            entries.resize(first);
+            exitStatus = FAILURE;
+            continue;
+        }
+
+        if (shardHeader.dataSize > 0) {
+            ifstream shardStream(shardData, ios::binary);
+            if (!(dataStream << shardStream.rdbuf())) {
+                cerr << "Error appending " << shardData << " to " <<
+                        dataFile << "." << endl;
+                return FAILURE;
+            }
+        }
+        for (size_t j = first; j < entries.size(); j++)
+            entries[j].offset += header.dataSize;
+        header.dataSize += shardHeader.dataSize;
+        merged.push_back(shardData);
+        merged.push_back(shardIndex);
+    }
+    dataStream.close();
+    if (!dataStream) {
+        cerr << "Error writing " << dataFile << "." << endl;
+        return FAILURE;
+    }
+
+    /* Build the hash table, at most half full; later keys replace earlier */
+    header.count = entries.size();
+    if (header.count > 0)
+        for (header.numSlots = 1; header.numSlots < 2 * header.count; )
+            header.numSlots <<= 1;
+    vector<uint64_t> slots(header.numSlots, 0);
+    const uint64_t mask = header.numSlots - 1;
+    for (uint64_t i = 0; i < header.count; i++) {
+        uint64_t h = hashKey(entries[i].key) & mask;
+        while (slots[h] != 0 && strcmp(entries[slots[h] - 1].key,
+                entries[i].key) != 0)
+            h = (h + 1) & mask;
+        slots[h] = i + 1;
+    }
+
+    /* Replace the index in one step */
+    string tmpFile = indexFile + ".tmp";
+    ofstream indexStream(tmpFile, ios::binary);
+    indexStream.write((const char*)&header, sizeof(header));
+    indexStream.write((const char*)entries.data(),
+            entries.size() * sizeof(TemplateIndexEntry));
+    indexStream.write((const char*)slots.data(), slots.size() * sizeof(uint64_t));
+    indexStream.close();
+    if (!indexStream || rename(tmpFile.c_str(), indexFile.c_str()) != 0) {
+        cerr << "Error writing " << indexFile << "." << endl;
+        remove(tmpFile.c_str());
+        return FAILURE;
+    }
+
+    for (const auto &file : merged)
+        if (remove(file.c_str()) != 0)
+            cerr << "Error deleting file: " << file << endl;
+    return exitStatus;
+}
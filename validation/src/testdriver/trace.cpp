@@ -0,0 +1,210 @@
+/**
+ * This software was developed at the National Institute of Standards and
+ * Technology (NIST) by employees of the Federal Government in the course
+ * of their official duties. Pursuant to title 17 Section 105 of the
+ * United States Code, this software is not subject to copyright protection
+ * and is in the public domain. NIST assumes no responsibility whatsoever for
+ * its use by other parties, and makes no guarantees, expressed or implied,
+ * about its quality, reliability, or any other characteristic.
+ **/
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include "latency.h"
+#include "merge.h"
+#include "trace.h"
+#include "util.h"
+
+using namespace std;
+
+struct TraceRecord {
+    const char *name;
+    uint64_t beginNs;
+    uint64_t endNs;
+    uint64_t items;
+};
+
+/* The events of one thread, appended to by that thread only */
+struct TraceBuffer {
+    pid_t pid;
+    pid_t tid;
+    string name;
+    vector<TraceRecord> records;
+};
+
+static bool enabled = false;
+static uint64_t originNs = 0;
+static string traceFile;
+
+/* Every buffer of the process; locked only to add a thread's buffer */
+static mutex registryMutex;
+static vector<unique_ptr<TraceBuffer>> registry;
+static thread_local TraceBuffer *current = nullptr;
+
+/*
+ * A forked child starts with copies of its parent's buffers; drop them
+ * so that the parent's events are written once, by the parent
+ */
+static void
+forgetParentEvents()
+{
+    registry.clear();
+    current = nullptr;
+}
+
+static TraceBuffer&
+threadBuffer()
+{
+    if (current == nullptr) {
+        unique_ptr<TraceBuffer> buffer(new TraceBuffer());
+        buffer->pid = getpid();
+        buffer->tid = syscall(SYS_gettid);
+        buffer->records.reserve(1 << 12);
+        current = buffer.get();
+        lock_guard<mutex> lock(registryMutex);
+        registry.push_back(move(buffer));
+    }
+    return (*current);
+}
+
+/* Writes every event and thread name of the process, each line ending in a comma */
+static void
+writeEvents(ostream &stream)
+{
+    stream << fixed << setprecision(3);
+    lock_guard<mutex> lock(registryMutex);
+    for (const auto &buffer : registry) {
+        if (!buffer->name.empty())
+            stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" <<
+                    buffer->pid << ",\"tid\":" << buffer->tid <<
+                    ",\"args\":{\"name\":\"" << buffer->name << "\"}},\n";
+        for (const auto &record : buffer->records)
+            stream << "{\"name\":\"" << record.name << "\",\"ph\":\"X\",\"pid\":" <<
+                    buffer->pid << ",\"tid\":" << buffer->tid << ",\"ts\":" <<
+                    (record.beginNs - originNs) / 1e3 << ",\"dur\":" <<
+                    (record.endNs - record.beginNs) / 1e3 <<
+                    ",\"args\":{\"items\":" << record.items << "}},\n";
+    }
+}
+
+/* The metadata line naming the calling process's track */
+static string
+processNameEvent(const string &name)
+{
+    return ("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" +
+            to_string(getpid()) + ",\"args\":{\"name\":\"" + name + "\"}}");
+}
+
+void
+traceStart(const string &file)
+{
+    traceFile = file;
+    originNs = monotonicNs();
+    enabled = true;
+    pthread_atfork(nullptr, nullptr, forgetParentEvents);
+}
+
+bool
+tracing()
+{
+    return enabled;
+}
+
+void
+traceThread(const string &name)
+{
+    if (enabled)
+        threadBuffer().name = name;
+}
+
+void
+traceEvent(
+        const char *name,
+        uint64_t beginNs,
+        uint64_t endNs,
+        uint64_t items)
+{
+    if (enabled)
+        threadBuffer().records.push_back({name, beginNs, endNs, items});
+}
+
+TraceSpan::TraceSpan(const char *name) :
+    name{name},
+    beginNs{enabled ? monotonicNs() : 0},
+    items{0}
+{}
+
+TraceSpan::~TraceSpan()
+{
+    if (enabled)
+        traceEvent(this->name, this->beginNs, monotonicNs(), this->items);
+}
+
+void
+TraceSpan::setItems(uint64_t items)
+{
+    this->items = items;
+}
+
+int
+traceWriteShard(
+        int shard,
+        const string &processName)
+{
+    const string file{shardFile(traceFile, shard)};
+    ofstream stream(file);
+    if (!stream.is_open()) {
+        cerr << "Failed to open stream for " << file << "." << endl;
+        return FAILURE;
+    }
+    writeEvents(stream);
+    stream << processNameEvent(processName) << ",\n";
+    stream.close();
+    if (!stream) {
+        cerr << "Error writing " << file << "." << endl;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+int
+traceFinish(
+        int numShards,
+        const string &processName)
+{
+    ofstream stream(traceFile);
+    if (!stream.is_open()) {
+        cerr << "Failed to open stream for " << traceFile << "." << endl;
+        return FAILURE;
+    }
+    stream << "[\n";
+    writeEvents(stream);
+
+    /* A worker that failed before writing its shard is left out */
+    for (int i = 0; i < numShards; i++) {
+        const string shard{shardFile(traceFile, i)};
+        ifstream shardStream(shard);
+        if (!shardStream.is_open())
+            continue;
+        if (shardStream.peek() != ifstream::traits_type::eof())
+            stream << shardStream.rdbuf();
+        shardStream.close();
+        remove(shard.c_str());
+    }
+
+    stream << processNameEvent(processName) << "\n]\n";
+    stream.close();
+    if (!stream) {
+        cerr << "Error writing " << traceFile << "." << endl;
+        return FAILURE;
+    }
+    return SUCCESS;
+}
@@ -8,17 +8,21 @@
  * about its quality, reliability, or any other characteristic.
  **/
 
-#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
 #include <limits>
-#include <fstream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "util.h"
 
 using namespace std;
 using namespace FRPC;
 
-static const string inputFileStem = "input.txt.";
-
 const char*
 to_string(ReturnCode code)
 {
@@ -46,6 +50,7 @@ to_string(Action action)
     switch (action) {
     case Action::CreateTemplate_11: return "createtemplate";
     case Action::Match_11: return "match";
+    case Action::Matrix_11: return "matrix";
     case Action::Enroll_1N: return "enroll";
     case Action::Finalize_1N: return "finalize";
     case Action::Search_1N: return "search";
@@ -53,108 +58,206 @@ to_string(Action action)
     }
 }
 
+bool
+mapFile(
+        const string &file,
+        shared_ptr<uint8_t> &mapping,
+        size_t &length,
+        bool writable)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd == -1) {
+        cerr << "Cannot open the input file " << file << endl;
+        return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 || sb.st_size == 0) {
+        cerr << "Error, cannot determine the size of " << file << "." << endl;
+        close(fd);
+        return false;
+    }
+
+    /*
+     * Data handed to implementations is mapped privately and writable so
+     * that implementations that modify it get copy-on-write pages instead
+     * of a fault.
+     */
+    length = sb.st_size;
+    void *addr = mmap(nullptr, length,
+            writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        cerr << "Error mapping " << file << ": " << strerror(errno) << endl;
+        return false;
+    }
+    size_t mappedLength = length;
+    mapping.reset(static_cast<uint8_t*>(addr),
+            [mappedLength](uint8_t *p) { munmap(p, mappedLength); });
+    return true;
+}
+
+bool
+mapShared(
+        size_t length,
+        shared_ptr<uint8_t> &mapping)
+{
+    void *addr = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        cerr << "Error mapping " << length << " bytes of shared memory: " <<
+                strerror(errno) << endl;
+        return false;
+    }
+    mapping.reset(static_cast<uint8_t*>(addr),
+            [length](uint8_t *p) { munmap(p, length); });
+    return true;
+}
+
+bool
+makeDirectory(const string &dir)
+{
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        cerr << "Failed to create " << dir << ": " << strerror(errno) << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Skips whitespace and comments between the fields of a PPM header.
+ * Returns a pointer to the next field, or end.
+ */
+static const uint8_t*
+skipHeaderSpace(
+        const uint8_t *p,
+        const uint8_t *end)
+{
+    while (p < end) {
+        if (*p == '#') {
+            while (p < end && *p != '\n')
+                p++;
+        } else if (isspace(*p)) {
+            p++;
+        } else
+            break;
+    }
+    return p;
+}
+
+/**
+ * Parses an unsigned decimal PPM header field and advances p past it.
+ */
+static bool
+parseHeaderField(
+        const uint8_t *&p,
+        const uint8_t *end,
+        uint32_t &value)
+{
+    p = skipHeaderSpace(p, end);
+    if (p == end || !isdigit(*p))
+        return false;
+    uint64_t v = 0;
+    while (p < end && isdigit(*p)) {
+        v = v * 10 + (*p++ - '0');
+        if (v > numeric_limits<uint32_t>::max())
+            return false;
+    }
+    value = static_cast<uint32_t>(v);
+    return true;
+}
+
 /**
- * Reads a PPM file into an Image object.
- * This function isn't intended to fully support the PPM format, only enough
- * to read the validation images.
+ * Reads a binary PPM (P6, colour) or PGM (P5, greyscale) file into an
+ * Image object.
+ * This function isn't intended to fully support the formats, only enough
+ * to read the validation images and those written by frpcgen.
+ *
+ * The file is memory-mapped and the header is parsed in place.  The
+ * returned Image aliases the raster inside the private mapping, which is
+ * unmapped when the last copy of the Image's data pointer is released, so
+ * no pixels are copied.
  */
 bool
 readImage(
         const string &file,
         Image &image)
 {
-    /* Open PPM file. */
-    ifstream input(file, ios::binary);
-    if (!input.is_open()) {
-        cerr << "Cannot open the input file " << file << endl;
+    /* Map PPM or PGM file. */
+    shared_ptr<uint8_t> mapping;
+    size_t length;
+    if (!mapFile(file, mapping, length, true))
         return false;
-    }
+    madvise(mapping.get(), length, MADV_SEQUENTIAL);
+    madvise(mapping.get(), length, MADV_WILLNEED);
+
+    const uint8_t *begin = mapping.get(), *end = begin + length;
+    const uint8_t *p = begin;
 
-    /* Read in magic number. */
-    string magicNumber;
-    input >> magicNumber;
-    if (magicNumber != "P6") {
+    /* Read in magic number: P6 for 24-bit colour, P5 for 8-bit grey. */
+    if (length < 2 || p[0] != 'P' || (p[1] != '6' && p[1] != '5')) {
         cerr << "Error reading magic number from file." << endl;
         return false;
     }
+    const uint8_t depth = (p[1] == '6' ? 24 : 8);
+    p += 2;
 
-    uint16_t maxValue;
     /* Read in image width, height, and max intensity value. */
-    input >> image.width >> image.height >> maxValue;
-    if (!input.good()) {
+    uint32_t width, height, maxValue;
+    if (!parseHeaderField(p, end, width) ||
+            !parseHeaderField(p, end, height) ||
+            !parseHeaderField(p, end, maxValue) ||
+            p == end || !isspace(*p)) {
         cerr << "Error, premature end of file while reading header." << endl;
         return false;
     }
-    image.depth = 24;
-
-    /* Skip line break. */
-    input.ignore(numeric_limits<streamsize>::max(), '\n');
+    if (width > numeric_limits<uint16_t>::max() ||
+            height > numeric_limits<uint16_t>::max() ||
+            maxValue == 0 || maxValue > 255) {
+        cerr << "Error, unsupported PPM/PGM dimensions or max value in " <<
+                file << "." << endl;
+        return false;
+    }
 
-    uint8_t *data = new uint8_t[image.size()];
-    image.data.reset(data, std::default_delete<uint8_t[]>());
+    /* Skip the single whitespace character that ends the header. */
+    p++;
 
-    /* Read in raw pixel data. */
-    input.read((char*)image.data.get(), image.size());
-    if (!input.good()) {
-        cerr << "Error, only read " << input.gcount() << " bytes." << endl;
+    image.width = width;
+    image.height = height;
+    image.depth = depth;
+    if (static_cast<size_t>(end - p) < image.size()) {
+        cerr << "Error, only read " << (end - p) << " bytes." << endl;
         return false;
     }
+
+    /* Point at the raw pixel data inside the mapping. */
+    image.data = shared_ptr<uint8_t>(mapping,
+            const_cast<uint8_t*>(p));
     return true;
 }
 
 int
-splitInputFile(
-        const string &inputFile,
-        const string &outputDir,
-        int &numForks,
-        vector<string> &fileVector)
+runThreads(
+        int numWorkers,
+        const function<int(int)> &work)
 {
-    /* Read input file */
-    ifstream inputStream(inputFile);
-    if (!inputStream.is_open()) {
-        cerr << "Failed to open stream for " << inputFile << "." << endl;
-        return FAILURE;
-    }
-
-    /* Count number of lines in file */
-    auto numLines = count(
-            istreambuf_iterator<char>(inputStream),
-            istreambuf_iterator<char>(), '\n');
-
-    inputStream.clear();
-    inputStream.seekg(0, ios::beg);
+    vector<int> results(numWorkers, FAILURE);
+    vector<thread> threads;
+    for (int i = 0; i < numWorkers; i++)
+        threads.push_back(thread([&results, &work, i]() {
+            try {
+                results[i] = work(i);
+            } catch (const exception &e) {
+                cerr << "Thread " << i << " failed: " << e.what() << endl;
+            }
+        }));
 
-    /**
-     * If the number of processes to fork is more than
-     * the number of lines in the file, set numForks
-     * to numLines
-     */
-    if (numLines < (uint32_t)numForks)
-        numForks = numLines;
-    /* This is the round-up of numLines/numForks */
-    int numLinesPerFork = numLines / numForks + (numLines
-            % numForks > 0 ? 1 : 0);
-    /* re-assign the number of forks if the numbers don't work out */
-    numForks = (numLines/numLinesPerFork) + ((numLines
-            % numLinesPerFork) > 0 ? 1 : 0);
-
-    for (int i = 0; i < numForks; i++) {
-        string filepath = outputDir + "/" + inputFileStem + to_string(i);
-        ofstream outputStream(filepath);
-        if (!outputStream.is_open()) {
-            cerr << "Failed to open stream for " << filepath << "." << endl;
-            return FAILURE;
-        }
-        fileVector.push_back(filepath);
-
-        for (int line_num = 1; line_num < numLinesPerFork + 1; line_num++) {
-            string line;
-            if (getline(inputStream, line))
-                outputStream << line << endl;
-            else
-                break;
+    auto exitStatus = SUCCESS;
+    for (int i = 0; i < numWorkers; i++) {
+        threads[i].join();
+        if (results[i] != SUCCESS) {
+            cerr << "Thread " << i << " exited with failure." << endl;
+            exitStatus = FAILURE;
         }
     }
-
-    return SUCCESS;
+    return exitStatus;
 }
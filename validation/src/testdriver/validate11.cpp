@@ -8,14 +8,28 @@
  * about its quality, reliability, or any other characteristic.
  */
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <cstring>
 #include <iterator>
+#include <new>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "asyncwriter.h"
+#include "columnar.h"
 #include "frpc.h"
+#include "input.h"
+#include "latency.h"
+#include "perfcounters.h"
+#include "progress.h"
+#include "resources.h"
+#include "trace.h"
+#include "scorematrix.h"
+#include "templatearena.h"
+#include "templatestore.h"
 #include "util.h"
 
 using namespace std;
@@ -42,23 +56,41 @@ readTemplateFromFile(
     return SUCCESS;
 }
 
+/**
+ * Reads the named template from the template store if one is given,
+ * otherwise from the file of that name in templatesDir
+ */
 int
-createTemplate(
-        shared_ptr<VerifInterface> &implPtr,
-        const string &inputFile,
-        const string &outputLog,
+readTemplate(
         const string &templatesDir,
-        TemplateRole role)
+        const TemplateStore *store,
+        const string &name,
+        vector<uint8_t> &templ)
 {
-    /* Read input file */
-    ifstream inputStream(inputFile);
-    if (!inputStream.is_open()) {
-        cerr << "Failed to open stream for " << inputFile << "." << endl;
+    if (store == nullptr)
+        return readTemplateFromFile(templatesDir + "/" + name, templ);
+    if (!store->read(name, templ)) {
+        cerr << "There is no template " << name << " in the template store "
+                "in " << templatesDir << "." << endl;
         return FAILURE;
     }
+    return SUCCESS;
+}
 
+int
+createTemplate(
+        shared_ptr<VerifInterface> &implPtr,
+        InputReader &reader,
+        const string &outputLog,
+        const string &templatesDir,
+        TemplateStoreWriter *store,
+        TemplateRole role,
+        int batchSize,
+        CallMeter &meter)
+{
     /* Open output log for writing */
-    ofstream logStream(outputLog);
+    AsyncWriter logStream;
+    logStream.open(outputLog);
     if (!logStream.is_open()) {
         cerr << "Failed to open stream for " << outputLog << "." << endl;
         return FAILURE;
@@ -66,116 +98,426 @@ createTemplate(
 
     /* header */
     logStream << "id image templateSizeBytes returnCode isLeftEyeAssigned "
-            "isRightEyeAssigned xleft yleft xright yright" << endl;
+            "isRightEyeAssigned xleft yleft xright yright\n";
+
+    string id, imagePath;
+    vector<string> ids, imagePaths;
+    vector<Image> faces;
+    while (true) {
+        /* Read the next batch of images */
+        ids.clear();
+        imagePaths.clear();
+        faces.clear();
+        uint64_t readStartNs = monotonicNs();
+        while ((int)faces.size() < batchSize && reader.next(id, imagePath)) {
+            Image face;
+            if (!reader.readImage(face)) {
+                cerr << "Failed to load image file: " << imagePath << "." << endl;
+                return FAILURE;
+            }
+            ids.push_back(id);
+            imagePaths.push_back(imagePath);
+            faces.push_back(face);
+        }
+        if (faces.empty())
+            break;
+        traceEvent("readImages", readStartNs, monotonicNs(), faces.size());
 
-    string id, imagePath, desc;
-    while (inputStream >> id >> imagePath) {
-        Image face;
-        if (!readImage(imagePath, face)) {
-            cerr << "Failed to load image file: " << imagePath << "." << endl;
+        vector<vector<uint8_t>> templs;
+        vector<EyePair> eyes;
+        vector<ReturnStatus> rets;
+        if (createTemplateBatch(*implPtr, faces, role, templs, eyes, rets,
+                meter) != SUCCESS)
             return FAILURE;
+
+        uint64_t failures = 0, bytes = 0;
+        for (size_t i = 0; i < faces.size(); i++) {
+            string templFile{ids[i] + ".template"};
+            if (store != nullptr) {
+                /* Append template to this worker's shard of the store */
+                if (!store->add(templFile, templs[i]))
+                    return FAILURE;
+            } else {
+                /* Open template file for writing */
+                ofstream templStream(templatesDir + "/" + templFile);
+                if (!templStream.is_open()) {
+                    cerr << "Failed to open stream for " << templatesDir + "/" + templFile << "." << endl;
+                    return FAILURE;
+                }
+
+                /* Write template file */
+                templStream.write((char*)templs[i].data(), templs[i].size());
+            }
+
+            /* Write template stats to log */
+            logStream << ids[i] << " "
+                    << imagePaths[i] << " "
+                    << templs[i].size() << " "
+                    << static_cast<underlying_type<ReturnCode>::type>(rets[i].code) << " "
+                    << eyes[i].isLeftAssigned << " "
+                    << eyes[i].isRightAssigned << " "
+                    << eyes[i].xleft << " "
+                    << eyes[i].yleft << " "
+                    << eyes[i].xright << " "
+                    << eyes[i].yright << " "
+                    << '\n';
+            reader.recordLogLines(1);
+            failures += (rets[i].code != ReturnCode::Success);
+            bytes += templs[i].size();
         }
+        meter.finished(faces.size(), failures, bytes);
+    }
 
-        vector<uint8_t> templ;
-        EyePair eyes;
-        auto ret = implPtr->createTemplate(face, role, templ, eyes);
+    return (logStream.close() ? SUCCESS : FAILURE);
+}
+
+/**
+ * Where a match worker reads templates from, and the buffers it reuses
+ * from one group of comparisons to the next
+ */
+struct MatchState {
+    string templatesDir;
+    /* Template store, or nullptr for one file per template */
+    const TemplateStore *store;
+    /* Preloaded templates, or nullptr to read templates per group */
+    const TemplateArena *arena;
+    /* Measures the worker's matchTemplatesBatch() calls */
+    CallMeter *meter;
+
+    /* Verification template of the previous group, if read */
+    string loadedVerifID;
+    vector<uint8_t> verifTempl;
+
+    vector<TemplateView> enrollViews;
+    vector<double> similarities;
+    vector<ReturnStatus> rets;
+};
 
-        /* Open template file for writing */
-        string templFile{id + ".template"};
-        ofstream templStream(templatesDir + "/" + templFile);
-        if (!templStream.is_open()) {
-            cerr << "Failed to open stream for " << templatesDir + "/" + templFile << "." << endl;
+/**
+ * Compares one verification template against a group of enrollment
+ * templates with a single matchTemplatesBatch() call and writes one
+ * score per pair, in input order, as a line to scoresStream or as a row
+ * to scoresColumns, whichever is not null.
+ */
+int
+matchGroup(
+        shared_ptr<VerifInterface> &implPtr,
+        InputReader &reader,
+        MatchState &state,
+        const string &verifID,
+        const vector<string> &enrollIDs,
+        ostream *scoresStream,
+        ColumnWriter *scoresColumns)
+{
+    auto &similarities = state.similarities;
+    auto &rets = state.rets;
+    similarities.clear();
+    rets.clear();
+
+    ReturnStatus ret;
+    if (state.arena != nullptr) {
+        /* Pass views into the arena; nothing is read or copied */
+        TemplateView verifView;
+        state.enrollViews.resize(enrollIDs.size());
+        bool found = state.arena->find(verifID, verifView);
+        for (size_t i = 0; found && i < enrollIDs.size(); i++)
+            found = state.arena->find(enrollIDs[i], state.enrollViews[i]);
+        if (!found) {
+            cerr << "A template compared with " << verifID <<
+                    " was not preloaded." << endl;
             return FAILURE;
         }
+        state.meter->begin();
+        ret = implPtr->matchTemplatesBatch(verifView, state.enrollViews,
+                similarities, rets);
+        state.meter->end(TimedCall::MatchTemplatesBatch, enrollIDs.size());
+    } else {
+        /* Consecutive groups may share the verification template */
+        if (verifID != state.loadedVerifID) {
+            if (readTemplate(state.templatesDir, state.store, verifID,
+                    state.verifTempl) != SUCCESS) {
+                cerr << "Unable to retrieve template from file : "
+                        << state.templatesDir + "/" + verifID << endl;
+                return FAILURE;
+            }
+            state.loadedVerifID = verifID;
+        }
 
-        /* Write template file */
-        templStream.write((char*)templ.data(), templ.size());
+        /* Read enrollment templates, reusing consecutive repeats */
+        vector<vector<uint8_t>> enrollTempls(enrollIDs.size());
+        vector<const vector<uint8_t>*> enrollPtrs(enrollIDs.size());
+        for (size_t i = 0; i < enrollIDs.size(); i++) {
+            if (i > 0 && enrollIDs[i] == enrollIDs[i-1]) {
+                enrollPtrs[i] = enrollPtrs[i-1];
+                continue;
+            }
+            if (readTemplate(state.templatesDir, state.store, enrollIDs[i],
+                    enrollTempls[i]) != SUCCESS) {
+                cerr << "Unable to retrieve template from file : "
+                        << state.templatesDir + "/" + enrollIDs[i] << endl;
+                return FAILURE;
+            }
+            enrollPtrs[i] = &enrollTempls[i];
+        }
 
-        /* Write template stats to log */
-        logStream << id << " "
-                << imagePath << " "
-                << templ.size() << " "
-                << static_cast<underlying_type<ReturnCode>::type>(ret.code) << " "
-                << eyes.isLeftAssigned << " "
-                << eyes.isRightAssigned << " "
-                << eyes.xleft << " "
-                << eyes.yleft << " "
-                << eyes.xright << " "
-                << eyes.yright << " "
-                << endl;
+        /* Call match */
+        state.meter->begin();
+        ret = implPtr->matchTemplatesBatch(state.verifTempl, enrollPtrs,
+                similarities, rets);
+        state.meter->end(TimedCall::MatchTemplatesBatch, enrollIDs.size());
+    }
+    if (ret.code != ReturnCode::Success) {
+        similarities.assign(enrollIDs.size(), -1.0);
+        rets.assign(enrollIDs.size(), ret);
+    } else if (similarities.size() != enrollIDs.size() || rets.size() != enrollIDs.size()) {
+        cerr << "matchTemplatesBatch() returned " << similarities.size() <<
+                " scores and " << rets.size() << " return statuses for " <<
+                enrollIDs.size() << " comparisons." << endl;
+        return FAILURE;
     }
-    inputStream.close();
-
-    /* Remove the input file */
-    if( remove(inputFile.c_str()) != 0 )
-        cerr << "Error deleting file: " << inputFile << endl;
 
+    /* Write to scores log file */
+    uint64_t failures = 0;
+    for (size_t i = 0; i < enrollIDs.size(); i++) {
+        failures += (rets[i].code != ReturnCode::Success);
+        if (scoresColumns != nullptr) {
+            scoresColumns->setString(0, enrollIDs[i]);
+            scoresColumns->setString(1, verifID);
+            scoresColumns->setDouble(2, similarities[i]);
+            scoresColumns->setInteger(3,
+                    static_cast<underlying_type<ReturnCode>::type>(rets[i].code));
+            scoresColumns->endRow();
+        } else
+            *scoresStream << enrollIDs[i] << " "
+                    << verifID << " "
+                    << similarities[i] << " "
+                    << static_cast<underlying_type<ReturnCode>::type>(rets[i].code)
+                    << '\n';
+        reader.recordLogLines(1);
+    }
+    state.meter->finished(enrollIDs.size(), failures, 0);
     return SUCCESS;
 }
 
 int
 match(
         shared_ptr<VerifInterface> &implPtr,
-        const string &inputFile,
+        InputReader &reader,
         const string &templatesDir,
-        const string &scoresLog)
+        const TemplateStore *store,
+        const TemplateArena *arena,
+        const string &scoresLog,
+        int batchSize,
+        bool columnar,
+        CallMeter &meter)
 {
-    /* Read probes */
-    ifstream inputStream(inputFile);
-    if (!inputStream.is_open()) {
-        cerr << "Failed to open stream for " << inputFile << "." << endl;
-        return FAILURE;
-    }
-
-    /* Open scores log for writing */
-    ofstream scoresStream(scoresLog);
-    if (!scoresStream.is_open()) {
+    /* Open scores log for writing, as text or columns */
+    AsyncWriter scoresStream;
+    ColumnWriter scoresColumns;
+    if (columnar ? !scoresColumns.open(scoresLog, scoreColumns()) :
+            !scoresStream.open(scoresLog)) {
         cerr << "Failed to open stream for " << scoresLog << "." << endl;
         return FAILURE;
     }
     /* header */
-    scoresStream << "enrollTempl verifTempl simScore returnCode" << endl;
-
-    /* Process each probe */
-    string enrollID, verifID;
-    while (inputStream >> enrollID >> verifID) {
-        vector<uint8_t> enrollTempl, verifTempl;
-        double similarity = -1.0;
-        /* Read templates from file */
-        if (readTemplateFromFile(templatesDir + "/" + enrollID, enrollTempl) != SUCCESS) {
-            cerr << "Unable to retrieve template from file : "
-                    << templatesDir + "/" + enrollID << endl;
-            return FAILURE;
+    if (!columnar)
+        scoresStream << "enrollTempl verifTempl simScore returnCode\n";
+
+    /*
+     * Process each probe, grouping up to batchSize consecutive pairs
+     * that share a verification template into one call
+     */
+    string enrollID, verifID, groupVerifID;
+    vector<string> enrollIDs;
+    MatchState state;
+    state.templatesDir = templatesDir;
+    state.store = store;
+    state.arena = arena;
+    state.meter = &meter;
+    bool more = true;
+    while (more) {
+        more = reader.next(enrollID, verifID);
+        if (more && !enrollIDs.empty() && verifID == groupVerifID &&
+                (int)enrollIDs.size() < batchSize) {
+            enrollIDs.push_back(enrollID);
+            continue;
         }
-        if (readTemplateFromFile(templatesDir + "/" + verifID, verifTempl) != SUCCESS) {
-            cerr << "Unable to retrieve template from file : "
-                    << templatesDir + "/" + verifID << endl;
-            return FAILURE;
+
+        if (!enrollIDs.empty()) {
+            if (matchGroup(implPtr, reader, state, groupVerifID, enrollIDs,
+                    columnar ? nullptr : &scoresStream,
+                    columnar ? &scoresColumns : nullptr) != SUCCESS)
+                return FAILURE;
+            enrollIDs.clear();
         }
+        if (more) {
+            groupVerifID = verifID;
+            enrollIDs.push_back(enrollID);
+        }
+    }
 
-        /* Call match */
-        auto ret = implPtr->matchTemplates(verifTempl, enrollTempl, similarity);
+    return ((columnar ? scoresColumns.close() : scoresStream.close()) ?
+            SUCCESS : FAILURE);
+}
+
+/** Approximate bytes of templates, enrollment and verification, per tile */
+static const uint64_t MatrixTileBytes = 1 << 20;
 
-        /* Write to scores log file */
-        scoresStream << enrollID << " "
-                << verifID << " "
-                << similarity << " "
-                << static_cast<underlying_type<ReturnCode>::type>(ret.code)
-                << endl;
+/**
+ * An all-vs-all comparison of enrollment and verification templates,
+ * divided into square tiles that workers claim from a shared counter
+ */
+struct MatrixJob {
+    TemplateArena arena;
+    vector<TemplateView> enrollViews;
+    vector<TemplateView> verifViews;
+    ScoreMatrix matrix;
+    /* Number of templates along each side of a tile */
+    uint64_t tileSize;
+    uint64_t rowTiles;
+    uint64_t colTiles;
+    shared_ptr<uint8_t> counterMemory;
+    atomic<uint64_t> *nextTile;
+};
+
+/**
+ * Reads the names of the templates created from a template creation
+ * list, in list order
+ */
+int
+readTemplateNames(
+        const string &list,
+        vector<string> &keys)
+{
+    shared_ptr<uint8_t> mapping;
+    size_t length;
+    if (isPackInput(list) || !mapFile(list, mapping, length)) {
+        cerr << "Failed to read template creation list " << list << "." << endl;
+        return FAILURE;
     }
-    inputStream.close();
+    const char *text = reinterpret_cast<const char*>(mapping.get());
+    TextReader reader(text, text + length);
+    string id, imagePath;
+    while (reader.next(id, imagePath))
+        keys.push_back(id + ".template");
+    return SUCCESS;
+}
 
-    /* Remove the input file */
-    if( remove(inputFile.c_str()) != 0 )
-        cerr << "Error deleting file: " << inputFile << endl;
+/**
+ * Preloads the templates of both lists, creates the score matrix file
+ * and divides it into tiles.  tileSize 0 picks tiles whose templates
+ * fit in about MatrixTileBytes.
+ */
+int
+prepareMatrix(
+        MatrixJob &job,
+        const string &enrollList,
+        const string &verifList,
+        const string &templatesDir,
+        const TemplateStore *store,
+        const string &matrixFile,
+        uint64_t tileSize)
+{
+    vector<string> enrollKeys, verifKeys;
+    if (readTemplateNames(enrollList, enrollKeys) != SUCCESS ||
+            readTemplateNames(verifList, verifKeys) != SUCCESS)
+        return FAILURE;
+    if (enrollKeys.empty() || verifKeys.empty()) {
+        cerr << "Both template lists must have at least one entry." << endl;
+        return FAILURE;
+    }
 
+    vector<string> keys(enrollKeys);
+    keys.insert(keys.end(), verifKeys.begin(), verifKeys.end());
+    if (job.arena.load(keys, templatesDir, store) != SUCCESS)
+        return FAILURE;
+    for (const auto &key : enrollKeys) {
+        job.enrollViews.push_back(TemplateView());
+        job.arena.find(key, job.enrollViews.back());
+    }
+    for (const auto &key : verifKeys) {
+        job.verifViews.push_back(TemplateView());
+        job.arena.find(key, job.verifViews.back());
+    }
+
+    if (tileSize == 0) {
+        uint64_t averageSize = max<uint64_t>(1, job.arena.size() / keys.size());
+        tileSize = max<uint64_t>(1, MatrixTileBytes / (2 * averageSize));
+    }
+    job.tileSize = tileSize;
+    job.rowTiles = (verifKeys.size() + tileSize - 1) / tileSize;
+    job.colTiles = (enrollKeys.size() + tileSize - 1) / tileSize;
+
+    if (!job.matrix.create(matrixFile, verifKeys, enrollKeys) ||
+            !mapShared(sizeof(atomic<uint64_t>), job.counterMemory))
+        return FAILURE;
+    job.nextTile = new (job.counterMemory.get()) atomic<uint64_t>(0);
+    return SUCCESS;
+}
+
+/**
+ * Claims tiles of the score matrix until there are none left.  Within a
+ * tile, each verification template (row) is compared with the tile's
+ * block of enrollment templates (columns) in one matchTemplatesBatch()
+ * call, whose scores fill a contiguous run of the row.
+ */
+int
+matrix(
+        shared_ptr<VerifInterface> &implPtr,
+        MatrixJob &job,
+        CallMeter &meter)
+{
+    const uint64_t rows = job.matrix.rows(), cols = job.matrix.cols();
+    const uint64_t numTiles = job.rowTiles * job.colTiles;
+    vector<TemplateView> block;
+    vector<double> similarities;
+    vector<ReturnStatus> rets;
+    for (uint64_t tile = job.nextTile->fetch_add(1); tile < numTiles;
+            tile = job.nextTile->fetch_add(1)) {
+        /* Views of the tile's enrollment templates, which stay in the arena */
+        uint64_t row = tile / job.colTiles * job.tileSize;
+        uint64_t rowEnd = min(row + job.tileSize, rows);
+        uint64_t col = tile % job.colTiles * job.tileSize;
+        uint64_t colEnd = min(col + job.tileSize, cols);
+        block.assign(job.enrollViews.begin() + col,
+                job.enrollViews.begin() + colEnd);
+
+        for (; row < rowEnd; row++) {
+            similarities.clear();
+            rets.clear();
+            meter.begin();
+            auto ret = implPtr->matchTemplatesBatch(job.verifViews[row], block,
+                    similarities, rets);
+            meter.end(TimedCall::MatchTemplatesBatch, block.size());
+            if (ret.code != ReturnCode::Success) {
+                similarities.assign(block.size(), -1.0);
+                rets.assign(block.size(), ret);
+            } else if (similarities.size() != block.size() ||
+                    rets.size() != block.size()) {
+                cerr << "matchTemplatesBatch() returned " << similarities.size() <<
+                        " scores and " << rets.size() << " return statuses for " <<
+                        block.size() << " comparisons." << endl;
+                return FAILURE;
+            }
+            uint64_t failures = 0;
+            for (size_t i = 0; i < block.size(); i++) {
+                job.matrix.set(row, col + i, similarities[i], rets[i].code);
+                failures += (rets[i].code != ReturnCode::Success);
+            }
+            /* A score and a return code per comparison */
+            meter.finished(block.size(), failures,
+                    block.size() * (sizeof(double) + 1));
+        }
+    }
     return SUCCESS;
 }
 
 void usage(const string &executable)
 {
-    cerr << "Usage: " << executable << " enroll|verif|match -c configDir "
-            "-o outputDir -h outputStem -i inputFile -t numForks -j templatesDir" << endl;
+    cerr << "Usage: " << executable << " enroll|verif|match|matrix -c configDir "
+            "-o outputDir -h outputStem -i inputFile -t numForks|-T numThreads "
+            "-j templatesDir [-b batchSize] [-q chunkSize] [-p prefetchDepth] [-s] [-a] "
+            "[-l] [-v verifList] [-k tileSize] [-F text|columnar] [-H] [-r] [-P seconds]" << endl;
     exit(EXIT_FAILURE);
 }
 
@@ -194,8 +536,13 @@ main(
         outputDir{"output"},
         outputFileStem{"stem"},
         inputFile,
+        verifList,
         templatesDir;
-    int numForks = 1;
+    int numForks = 1, batchSize = 1, numThreads = 0, prefetchDepth = 0,
+            progressInterval = 0;
+    int64_t chunkSize = 0, tileSize = 0;
+    bool useStore = false, useArena = false, grouped = false, columnar = false,
+            countEvents = false, timeline = false;
 
     for (int i = 0; i < argc - requiredArgs; i++) {
         if (strcmp(argv[requiredArgs+i],"-c") == 0)
@@ -210,11 +557,57 @@ main(
             templatesDir = argv[requiredArgs+(++i)];
         else if (strcmp(argv[requiredArgs+i],"-t") == 0)
             numForks = atoi(argv[requiredArgs+(++i)]);
+        else if (strcmp(argv[requiredArgs+i],"-b") == 0)
+            batchSize = atoi(argv[requiredArgs+(++i)]);
+        else if (strcmp(argv[requiredArgs+i],"-T") == 0)
+            numThreads = atoi(argv[requiredArgs+(++i)]);
+        else if (strcmp(argv[requiredArgs+i],"-q") == 0)
+            chunkSize = atoll(argv[requiredArgs+(++i)]);
+        else if (strcmp(argv[requiredArgs+i],"-p") == 0)
+            prefetchDepth = atoi(argv[requiredArgs+(++i)]);
+        else if (strcmp(argv[requiredArgs+i],"-F") == 0) {
+            string format{argv[requiredArgs+(++i)]};
+            if (format != "text" && format != "columnar") {
+                cerr << "Unknown output format: " << format << endl;
+                usage(argv[0]);
+            }
+            columnar = (format == "columnar");
+        }
+        else if (strcmp(argv[requiredArgs+i],"-s") == 0)
+            useStore = true;
+        else if (strcmp(argv[requiredArgs+i],"-a") == 0)
+            useArena = true;
+        else if (strcmp(argv[requiredArgs+i],"-l") == 0)
+            grouped = true;
+        else if (strcmp(argv[requiredArgs+i],"-H") == 0)
+            countEvents = true;
+        else if (strcmp(argv[requiredArgs+i],"-r") == 0)
+            timeline = true;
+        else if (strcmp(argv[requiredArgs+i],"-P") == 0)
+            progressInterval = atoi(argv[requiredArgs+(++i)]);
+        else if (strcmp(argv[requiredArgs+i],"-v") == 0)
+            verifList = argv[requiredArgs+(++i)];
+        else if (strcmp(argv[requiredArgs+i],"-k") == 0)
+            tileSize = atoll(argv[requiredArgs+(++i)]);
         else {
             cerr << "Unrecognized flag: " << argv[requiredArgs+i] << endl;;
             usage(argv[0]);
         }
     }
+    if (batchSize < 1) {
+        cerr << "Batch size must be at least 1." << endl;
+        usage(argv[0]);
+    }
+    if (numThreads < 0 || (numThreads > 0 && numForks > 1)) {
+        cerr << "Specify either a number of processes to fork or a number "
+                "of threads." << endl;
+        usage(argv[0]);
+    }
+    if (chunkSize < 0 || tileSize < 0 || prefetchDepth < 0 || progressInterval < 0) {
+        cerr << "Chunk and tile sizes, prefetch depth and progress interval "
+                "must not be negative." << endl;
+        usage(argv[0]);
+    }
 
     Action action;
     TemplateRole role = TemplateRole::Enrollment_11;
@@ -224,31 +617,243 @@ main(
         else role = TemplateRole::Verification_11;
     } else if(actionstr == "match")
         action = Action::Match_11;
+    else if(actionstr == "matrix")
+        action = Action::Matrix_11;
     else {
         cerr << "Unknown command: " << actionstr << endl;
         usage(argv[0]);
     }
+    if (action == Action::Matrix_11 && verifList.empty()) {
+        cerr << "matrix requires a verification list (-v)." << endl;
+        usage(argv[0]);
+    }
+
+    /*
+     * Time the interface calls of every worker, optionally counting
+     * hardware events and recording a timeline, and sample the resource
+     * usage of the parent and the workers at the end of each phase
+     */
+    LatencyRecorder latency;
+    CounterRecorder counters;
+    ResourceRecorder resources;
+    if (!latency.create(numThreads > 0 ? numThreads : numForks) ||
+            (countEvents && !counters.create(numThreads > 0 ? numThreads : numForks)) ||
+            !resources.create(numThreads > 0 ? numThreads : numForks))
+        return FAILURE;
+    /* Reports are named per action, so the actions can share outputDir */
+    const string reportStem{outputDir + "/" + outputFileStem + "." + actionstr};
+    if (timeline) {
+        traceStart(reportStem + ".trace.json");
+        traceThread("main");
+    }
 
     /* Get implementation pointer */
     auto implPtr = VerifInterface::getImplementation();
-    /* Initialization */
-    auto ret = implPtr->initialize(configDir);
+    /* Initialization, counted on counters closed before workers start */
+    ReturnStatus ret;
+    {
+        CallMeter meter(latency.worker(0), counters.worker(0));
+        meter.begin();
+        ret = implPtr->initialize(configDir);
+        meter.end(TimedCall::Initialize, 1);
+    }
     if (ret.code != ReturnCode::Success) {
         cerr << "initialize() returned error code: "
                 << ret.code << "." << endl;
         return FAILURE;
     }
+    resources.sample(-1, "initialize", ResourceScope::Process);
+    if (numThreads > 0) {
+        if (!implPtr->isThreadSafe()) {
+            cerr << "The implementation does not declare itself "
+                    "thread-safe; use -t numForks instead of -T." << endl;
+            return FAILURE;
+        }
+        numForks = numThreads;
+    }
+
+    if (action == Action::Match_11 && columnar && (chunkSize > 0 || grouped)) {
+        cerr << "Columnar score logs cannot be put back in input order; "
+                "use -F text with -q or -l." << endl;
+        return FAILURE;
+    }
+    if (action == Action::Match_11 && isPackInput(inputFile)) {
+        cerr << "Image packs cannot be used as match input." << endl;
+        return FAILURE;
+    }
 
-    /* Split input file into appropriate number of splits */
-    vector<string> inputFileVector;
-    if (splitInputFile(inputFile, outputDir, numForks, inputFileVector) != SUCCESS) {
+    /*
+     * Divide the input into appropriate number of partitions, or queue
+     * it for the workers to claim chunkSize entries at a time.  With -l,
+     * comparisons are grouped by verification template, then enrollment
+     * template, so that each template is used by one worker while it is
+     * hot and each group becomes a single matchTemplatesBatch() call.
+     */
+    InputList inputList;
+    if (action != Action::Matrix_11 && inputList.open(inputFile, numForks, chunkSize,
+            grouped && action == Action::Match_11) != SUCCESS) {
         cerr << "An error occurred with processing the input file." << endl;
         return FAILURE;
     }
+    /* Map the template store before forking so that workers share it */
+    TemplateStore store;
+    if (useStore && (action == Action::Match_11 || action == Action::Matrix_11) &&
+            !store.open(templatesDir)) {
+        cerr << "Failed to open the template store in " << templatesDir << "." << endl;
+        return FAILURE;
+    }
+
+    /*
+     * Preload every template the match list refers to, so that workers
+     * compare views into shared memory instead of reading templates
+     */
+    TemplateArena arena;
+    if (useArena && action == Action::Match_11 && arena.loadMatchList(inputFile,
+            templatesDir, useStore ? &store : nullptr) != SUCCESS) {
+        cerr << "Failed to preload the templates of " << inputFile << "." << endl;
+        return FAILURE;
+    }
+
+    /* Compare every template of one list with every template of the other */
+    MatrixJob matrixJob;
+    if (action == Action::Matrix_11) {
+        if (prepareMatrix(matrixJob, inputFile, verifList, templatesDir,
+                useStore ? &store : nullptr,
+                outputDir + "/" + outputFileStem + ".matrix", tileSize) != SUCCESS) {
+            cerr << "An error occurred with preparing the score matrix." << endl;
+            return FAILURE;
+        }
+        if ((uint64_t)numForks > matrixJob.rowTiles * matrixJob.colTiles)
+            numForks = matrixJob.rowTiles * matrixJob.colTiles;
+    }
+    if (useArena || action == Action::Matrix_11)
+        resources.sample(-1, "preload", ResourceScope::Process);
+
+    /* Columnar score logs are named outputStem.log.cols.N */
+    const int numWorkers = numForks;
+    vector<string> logs;
+    const string logFormat{(columnar && action == Action::Match_11) ? ".cols" : ""};
+    for (int i = 0; i < numWorkers; i++)
+        logs.push_back(outputDir + "/" + outputFileStem + ".log" + logFormat +
+                "." + to_string(i));
+
+    /* Workers count what they finish; with -P it is reported as they run */
+    ProgressRecorder progress;
+    if (!progress.create(numWorkers))
+        return FAILURE;
+    const uint64_t totalItems = (action == Action::Matrix_11 ?
+            matrixJob.matrix.rows() * matrixJob.matrix.cols() : inputList.size());
+
+    /* Process partition i of the input */
+    auto process = [&](int i) -> int {
+        CallMeter meter(latency.worker(i), counters.worker(i), progress.worker(i));
+        if (action == Action::Matrix_11)
+            return matrix(implPtr, matrixJob, meter);
+        auto reader = inputList.reader(i);
+        if (!reader)
+            return FAILURE;
+        if (action == Action::CreateTemplate_11) {
+            /* Decode upcoming images while templates are created */
+            if (prefetchDepth > 0)
+                reader.reset(new PrefetchReader(move(reader), prefetchDepth));
+
+            TemplateStoreWriter writer;
+            if (useStore && !writer.open(templatesDir, i))
+                return FAILURE;
+            if (createTemplate(
+                    implPtr,
+                    *reader,
+                    logs[i],
+                    templatesDir,
+                    useStore ? &writer : nullptr,
+                    role,
+                    batchSize,
+                    meter) != SUCCESS)
+                return FAILURE;
+            return ((useStore && !writer.close()) ? FAILURE : SUCCESS);
+        } else
+            return match(
+                    implPtr,
+                    *reader,
+                    templatesDir,
+                    useStore ? &store : nullptr,
+                    useArena ? &arena : nullptr,
+                    logs[i],
+                    batchSize,
+                    columnar,
+                    meter);
+    };
+    /*
+     * A thread's memory is that of the whole process.  A forked worker
+     * hands its part of the timeline to the parent through a shard.
+     */
+    auto work = [&](int i) -> int {
+        auto scope = (numThreads > 0 ? ResourceScope::Thread : ResourceScope::Process);
+        const string name{"worker " + to_string(i)};
+        traceThread(name);
+        resources.sample(i, "start", scope);
+        int status;
+        {
+            TraceSpan span(actionstr.c_str());
+            status = process(i);
+        }
+        progress.worker(i)->finished = 1;
+        resources.sample(i, actionstr.c_str(), scope);
+        if (tracing() && numThreads == 0 && traceWriteShard(i, name) != SUCCESS)
+            status = FAILURE;
+        return status;
+    };
+
+    /*
+     * Combine the output of the workers once they have all finished.  The
+     * logs of a failed worker may be cut short, so they are left unmerged.
+     */
+    auto combine = [&](bool workersSucceeded) -> int {
+        auto status = SUCCESS;
+        if (!workersSucceeded) {
+            if (inputList.isIndexed())
+                cerr << "Leaving the log of each worker unmerged, since a "
+                        "worker failed." << endl;
+            status = FAILURE;
+        } else if (inputList.restoreLogOrder(logs) != SUCCESS)
+            status = FAILURE;
+        if (useStore && action == Action::CreateTemplate_11 &&
+                mergeTemplateStore(templatesDir, numWorkers) != SUCCESS)
+            status = FAILURE;
+        if (latency.writeSummary(reportStem + ".latency") != SUCCESS ||
+                resources.writeReport(reportStem + ".resources") != SUCCESS)
+            status = FAILURE;
+        if (countEvents && counters.writeReport(reportStem + ".counters") != SUCCESS)
+            status = FAILURE;
+        if (tracing() && traceFinish(numThreads > 0 ? 0 : numWorkers,
+                "validate11 " + actionstr) != SUCCESS)
+            status = FAILURE;
+        return status;
+    };
+
+    if (numThreads > 0) {
+        /*
+         * Threads -- one thread per partition, sharing this process's
+         * implementation instance.  Each thread writes the same per-partition
+         * output files as a forked child would.
+         */
+        ret = implPtr->setGPU(0);
+        if (ret.code != ReturnCode::Success) {
+            cerr << "setGPU() returned error code: "
+                    << ret.code << "." << endl;
+            return FAILURE;
+        }
+        progress.startReports(progressInterval, totalItems);
+        exitStatus = runThreads(numForks, work);
+        progress.stopReports();
+        resources.sample(-1, "workers", ResourceScope::Process);
+        if (combine(exitStatus == SUCCESS) != SUCCESS)
+            exitStatus = FAILURE;
+        return exitStatus;
+    }
 
     bool parent = false;
-    int i = 0;
-    for (auto &inputFile : inputFileVector) {
+    for (int i = 0; i < numForks; i++) {
         /* Fork */
         switch(fork()) {
         case 0: /* Child */
@@ -258,39 +863,32 @@ main(
                         << ret.code << "." << endl;
                 return FAILURE;
             }
-
-            if (action == Action::CreateTemplate_11)
-                return createTemplate(
-                        implPtr,
-                        inputFile,
-                        outputDir + "/" + outputFileStem + ".log." + to_string(i),
-                        templatesDir,
-                        role);
-            else if (action == Action::Match_11)
-                return match(
-                        implPtr,
-                        inputFile,
-                        templatesDir,
-                        outputDir + "/" + outputFileStem + ".log." + to_string(i));
+            return work(i);
         case -1: /* Error */
             cerr << "Problem forking" << endl;
+            exitStatus = FAILURE;
             break;
         default: /* Parent */
             parent = true;
             break;
         }
-        i++;
     }
 
     /* Parent -- wait for children */
     if (parent) {
+        progress.startReports(progressInterval, totalItems);
         while (numForks > 0) {
             int stat_val;
             pid_t cpid;
 
             cpid = wait(&stat_val);
-            if (WIFEXITED(stat_val)) {}
-            else if (WIFSIGNALED(stat_val)) {
+            if (WIFEXITED(stat_val)) {
+                if (WEXITSTATUS(stat_val) != SUCCESS) {
+                    cerr << "PID " << cpid << " exited with status " <<
+                            WEXITSTATUS(stat_val) << endl;
+                    exitStatus = FAILURE;
+                }
+            } else if (WIFSIGNALED(stat_val)) {
                 cerr << "PID " << cpid << " exited due to signal " <<
                         WTERMSIG(stat_val) << endl;
                 exitStatus = FAILURE;
@@ -300,6 +898,11 @@ main(
             }
             numForks--;
         }
+        progress.stopReports();
+        resources.sample(-1, "workers", ResourceScope::Process);
+        resources.sample(-1, "children", ResourceScope::Children);
+        if (combine(exitStatus == SUCCESS) != SUCCESS)
+            exitStatus = FAILURE;
     }
 
     return exitStatus;
@@ -14,7 +14,16 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "asyncwriter.h"
+#include "columnar.h"
 #include "frpc.h"
+#include "input.h"
+#include "latency.h"
+#include "perfcounters.h"
+#include "progress.h"
+#include "resources.h"
+#include "trace.h"
+#include "sharededb.h"
 #include "util.h"
 
 using namespace std;
@@ -23,20 +32,15 @@ using namespace FRPC;
 int
 enroll(shared_ptr<IdentInterface> &implPtr,
 		const string &configDir,
-		const string &inputFile,
+		InputReader &reader,
 		const string &outputLog,
-		const string &edb,
-		const string &manifest)
+		SharedEDB &edb,
+		int batchSize,
+		CallMeter &meter)
 {
-	/* Read input file */
-	ifstream inputStream(inputFile);
-	if (!inputStream.is_open()) {
-		cerr << "Failed to open stream for " << inputFile << "." << endl;
-		return FAILURE;
-	}
-
 	/* Open output log for writing */
-	ofstream logStream(outputLog);
+	AsyncWriter logStream;
+	logStream.open(outputLog);
 	if (!logStream.is_open()) {
 		cerr << "Failed to open stream for " << outputLog << "." << endl;
 		return FAILURE;
@@ -44,68 +48,75 @@ enroll(shared_ptr<IdentInterface> &implPtr,
 
 	/* header */
     logStream << "id image returnCode templateSizeBytes isLeftEyeAssigned "
-            "isRightEyeAssigned xleft yleft xright yright" << endl;
+            "isRightEyeAssigned xleft yleft xright yright\n";
 
-	/* Open EDB file for writing */
-	ofstream edbStream(edb);
-	if (!edbStream.is_open()) {
-		cerr << "Failed to open stream for " << edb << "." << endl;
-		return FAILURE;
-	}
-
-	/* Open manifest for writing */
-	ofstream manifestStream(manifest);
-	if (!manifestStream.is_open()) {
-		cerr << "Failed to open stream for " << manifest << "." << endl;
-		return FAILURE;
-	}
+	/* Templates are batched and written behind the worker */
+	EDBWriter edbWriter(edb);
 
 	string id, imagePath;
-	while (inputStream >> id >> imagePath) {
-		Image face;
-		if (!readImage(imagePath, face)) {
-			cerr << "Failed to load image file: " << imagePath << "." << endl;
-			return FAILURE;
+	vector<string> ids, imagePaths;
+	vector<Image> faces;
+	while (true) {
+		/* Read the next batch of images */
+		ids.clear();
+		imagePaths.clear();
+		faces.clear();
+		uint64_t readStartNs = monotonicNs();
+		while ((int)faces.size() < batchSize && reader.next(id, imagePath)) {
+			Image face;
+			if (!reader.readImage(face)) {
+				cerr << "Failed to load image file: " << imagePath << "." << endl;
+				return FAILURE;
+			}
+			ids.push_back(id);
+			imagePaths.push_back(imagePath);
+			faces.push_back(face);
 		}
-
-        vector <uint8_t> templ;
-        EyePair eyes;
-        auto ret = implPtr->createTemplate(face, TemplateRole::Enrollment_1N, templ, eyes);
+		if (faces.empty())
+			break;
+		traceEvent("readImages", readStartNs, monotonicNs(), faces.size());
+
+		vector<vector<uint8_t>> templs;
+		vector<EyePair> eyes;
+		vector<ReturnStatus> rets;
+		if (createTemplateBatch(*implPtr, faces, TemplateRole::Enrollment_1N,
+				templs, eyes, rets, meter) != SUCCESS)
+			return FAILURE;
 
 		/* Write to edb and manifest */
-		manifestStream << id << " "
-				<< templ.size() << " "
-				<< edbStream.tellp() << endl;
-		edbStream.write(
-				(char*)templ.data(),
-				templ.size());
-
-        /* Write template stats to log */
-        logStream << id << " "
-                << imagePath << " "
-                << static_cast<underlying_type<ReturnCode>::type>(ret.code) << " "
-                << templ.size() << " "
-                << eyes.isLeftAssigned << " "
-                << eyes.isRightAssigned << " "
-                << eyes.xleft << " "
-                << eyes.yleft << " "
-                << eyes.xright << " "
-                << eyes.yright << " "
-                << endl;
-	}
-	inputStream.close();
+		if (!edbWriter.add(ids, templs))
+			return FAILURE;
 
-    /* Remove the input file */
-    if( remove(inputFile.c_str()) != 0 )
-        cerr << "Error deleting file: " << inputFile << endl;
+		uint64_t failures = 0, bytes = 0;
+		for (size_t i = 0; i < faces.size(); i++) {
+			/* Write template stats to log */
+			logStream << ids[i] << " "
+					<< imagePaths[i] << " "
+					<< static_cast<underlying_type<ReturnCode>::type>(rets[i].code) << " "
+					<< templs[i].size() << " "
+					<< eyes[i].isLeftAssigned << " "
+					<< eyes[i].isRightAssigned << " "
+					<< eyes[i].xleft << " "
+					<< eyes[i].yleft << " "
+					<< eyes[i].xright << " "
+					<< eyes[i].yright << " "
+					<< '\n';
+			reader.recordLogLines(1);
+			failures += (rets[i].code != ReturnCode::Success);
+			bytes += templs[i].size();
+		}
+		meter.finished(faces.size(), failures, bytes);
+	}
 
-	return SUCCESS;
+	bool written = edbWriter.close();
+	return (logStream.close() && written ? SUCCESS : FAILURE);
 }
 
 int
 finalize(shared_ptr<IdentInterface> &implPtr,
 		const string &edbDir,
-		const string &enrollDir)
+		const string &enrollDir,
+		CallMeter &meter)
 {
 	string edb{edbDir+"/edb"}, manifest{edbDir+"/manifest"};
 	/* Check file existence of edb and manifest */
@@ -115,7 +126,9 @@ finalize(shared_ptr<IdentInterface> &implPtr,
 		return FAILURE;
 	}
 
+	meter.begin();
 	auto ret = implPtr->finalizeEnrollment(enrollDir, edb, manifest);
+	meter.end(TimedCall::FinalizeEnrollment, 1);
 	if (ret.code != ReturnCode::Success) {
 		cerr << "finalizeEnrollment() returned error code: "
 				<< to_string(ret.code) << "." << endl;
@@ -124,54 +137,74 @@ finalize(shared_ptr<IdentInterface> &implPtr,
 	return SUCCESS;
 }
 
+/**
+ * A probe whose template has been created but whose candidate
+ * list has not yet been written
+ */
+struct PendingProbe {
+	string id;
+	ReturnStatus ret;
+	vector<uint8_t> templ;
+};
+
+/**
+ * Searches the successfully created templates among the pending probes
+ * with a single identifyTemplates() call, then writes the candidate lists
+ * of all pending probes in input order, as text to candListStream or as
+ * rows to candListColumns, whichever is not null.
+ */
 int
-search(shared_ptr<IdentInterface> &implPtr,
-		const string &configDir,
-		const string &enrollDir,
-		const string &inputFile,
-		const string &candList)
+searchPending(shared_ptr<IdentInterface> &implPtr,
+		InputReader &reader,
+		vector<PendingProbe> &pending,
+		uint32_t candListLength,
+		ostream *candListStream,
+		ColumnWriter *candListColumns,
+		CallMeter &meter)
 {
-	int candListLength{20};
-
-	/* Read probes */
-	ifstream inputStream(inputFile);
-	if (!inputStream.is_open()) {
-		cerr << "Failed to open stream for " << inputFile << "." << endl;
-		return FAILURE;
-	}
-
-	/* Open candidate list log for writing */
-	ofstream candListStream(candList);
-	if (!candListStream.is_open()) {
-		cerr << "Failed to open stream for " << candList << "." << endl;
-		return FAILURE;
-	}
-	/* header */
-	candListStream << "searchId candidateRank searchRetCode "
-			"isAssigned templateId score decision" << endl;
-
-	/* Process each probe */
-	string id, imagePath;
-	while (inputStream >> id >> imagePath) {
-		Image face;
-		if (!readImage(imagePath, face)) {
-			cerr << "Failed to load image file: " << imagePath << "." << endl;
+	vector<const vector<uint8_t>*> templs;
+	for (const auto &probe : pending)
+		if (probe.ret.code == ReturnCode::Success)
+			templs.push_back(&probe.templ);
+
+	vector<vector<Candidate>> candidateLists;
+	vector<bool> decisions;
+	vector<ReturnStatus> rets;
+	if (!templs.empty()) {
+		meter.begin();
+		auto ret = implPtr->identifyTemplates(
+				templs,
+				candListLength,
+				candidateLists,
+				decisions,
+				rets);
+		meter.end(TimedCall::IdentifyTemplates, templs.size());
+		if (ret.code != ReturnCode::Success) {
+			candidateLists.assign(templs.size(), vector<Candidate>());
+			decisions.assign(templs.size(), false);
+			rets.assign(templs.size(), ret);
+		} else if (candidateLists.size() != templs.size() ||
+				decisions.size() != templs.size() ||
+				rets.size() != templs.size()) {
+			cerr << "identifyTemplates() returned " << candidateLists.size() <<
+					" candidate lists, " << decisions.size() << " decisions and " <<
+					rets.size() << " return statuses for " << templs.size() <<
+					" templates." << endl;
 			return FAILURE;
 		}
+	}
 
-        vector<uint8_t> templ;
-        EyePair eyes;
-        auto ret = implPtr->createTemplate(face, TemplateRole::Search_1N, templ, eyes);
-
+	size_t searched{0};
+	uint64_t failures{0};
+	for (auto &probe : pending) {
 		vector<Candidate> candidateList;
 		bool decision = false;
-		if (ret.code == ReturnCode::Success) {
-			ret = implPtr->identifyTemplate(
-					templ,
-					candListLength,
-					candidateList,
-					decision);
-			if (ret.code != ReturnCode::Success) {
+		if (probe.ret.code == ReturnCode::Success) {
+			probe.ret = rets[searched];
+			decision = decisions[searched];
+			candidateList.swap(candidateLists[searched]);
+			searched++;
+			if (probe.ret.code != ReturnCode::Success) {
 				/* Populate candidate list with null entries */
 				candidateList.resize(candListLength);
 			}
@@ -182,27 +215,121 @@ search(shared_ptr<IdentInterface> &implPtr,
 
 		/* Write to candidate list file */
 		int i{0};
-		for (const auto& candidate : candidateList)
-			candListStream << id << " " << i++ << " "
-			<< static_cast<underlying_type<ReturnCode>::type>(ret.code) << " "
-			<< candidate.isAssigned << " "
-			<< candidate.templateId << " "
-			<< candidate.similarityScore << " "
-			<< decision << endl;
+		for (const auto& candidate : candidateList) {
+			if (candListColumns != nullptr) {
+				candListColumns->setString(0, probe.id);
+				candListColumns->setInteger(1, i++);
+				candListColumns->setInteger(2,
+						static_cast<underlying_type<ReturnCode>::type>(probe.ret.code));
+				candListColumns->setInteger(3, candidate.isAssigned);
+				candListColumns->setString(4, candidate.templateId);
+				candListColumns->setDouble(5, candidate.similarityScore);
+				candListColumns->setInteger(6, decision);
+				candListColumns->endRow();
+			} else
+				*candListStream << probe.id << " " << i++ << " "
+				<< static_cast<underlying_type<ReturnCode>::type>(probe.ret.code) << " "
+				<< candidate.isAssigned << " "
+				<< candidate.templateId << " "
+				<< candidate.similarityScore << " "
+				<< decision << '\n';
+		}
+		reader.recordLogLines(candidateList.size());
+		failures += (probe.ret.code != ReturnCode::Success);
+	}
+	meter.finished(pending.size(), failures, 0);
+	pending.clear();
+	return SUCCESS;
+}
+
+int
+search(shared_ptr<IdentInterface> &implPtr,
+		const string &configDir,
+		const string &enrollDir,
+		InputReader &reader,
+		const string &candList,
+		int batchSize,
+		bool columnar,
+		CallMeter &meter)
+{
+	int candListLength{20};
+
+	/* Open candidate list log for writing, as text or columns */
+	AsyncWriter candListStream;
+	ColumnWriter candListColumns;
+	if (columnar ? !candListColumns.open(candList, candidateListColumns()) :
+			!candListStream.open(candList)) {
+		cerr << "Failed to open stream for " << candList << "." << endl;
+		return FAILURE;
 	}
-    inputStream.close();
+	/* header */
+	if (!columnar)
+		candListStream << "searchId candidateRank searchRetCode "
+				"isAssigned templateId score decision\n";
+
+	/*
+	 * Process each probe.  Templates are created batchSize images at a time
+	 * and searched once batchSize of them have been created successfully.
+	 */
+	string id, imagePath;
+	vector<string> ids;
+	vector<Image> faces;
+	vector<PendingProbe> pending;
+	int numPendingSearches{0};
+	while (true) {
+		/* Read the next batch of images */
+		ids.clear();
+		faces.clear();
+		uint64_t readStartNs = monotonicNs();
+		while ((int)faces.size() < batchSize && reader.next(id, imagePath)) {
+			Image face;
+			if (!reader.readImage(face)) {
+				cerr << "Failed to load image file: " << imagePath << "." << endl;
+				return FAILURE;
+			}
+			ids.push_back(id);
+			faces.push_back(face);
+		}
 
-    /* Remove the input file */
-    if( remove(inputFile.c_str()) != 0 )
-        cerr << "Error deleting file: " << inputFile << endl;
+		if (!faces.empty()) {
+			traceEvent("readImages", readStartNs, monotonicNs(), faces.size());
+			vector<vector<uint8_t>> templs;
+			vector<EyePair> eyes;
+			vector<ReturnStatus> rets;
+			if (createTemplateBatch(*implPtr, faces, TemplateRole::Search_1N,
+					templs, eyes, rets, meter) != SUCCESS)
+				return FAILURE;
+
+			for (size_t i = 0; i < faces.size(); i++) {
+				pending.push_back(PendingProbe());
+				pending.back().id = ids[i];
+				pending.back().ret = rets[i];
+				pending.back().templ.swap(templs[i]);
+				if (rets[i].code == ReturnCode::Success)
+					numPendingSearches++;
+			}
+		}
 
-	return SUCCESS;
+		if (faces.empty() || numPendingSearches >= batchSize) {
+			if (searchPending(implPtr, reader, pending, candListLength,
+					columnar ? nullptr : &candListStream,
+					columnar ? &candListColumns : nullptr, meter) != SUCCESS)
+				return FAILURE;
+			numPendingSearches = 0;
+		}
+		if (faces.empty())
+			break;
+	}
+
+	return ((columnar ? candListColumns.close() : candListStream.close()) ?
+			SUCCESS : FAILURE);
 }
 
 void usage(const string &executable)
 {
     cerr << "Usage: " << executable << " enroll|finalize|search -c configDir -e enrollDir "
-            "-o outputDir -h outputStem -i inputFile -t numForks" << endl;
+            "-o outputDir -h outputStem -i inputFile -t numForks|-T numThreads [-b batchSize] "
+            "[-q chunkSize] [-p prefetchDepth] [-F text|columnar] [-H] [-r] [-P seconds]" << endl;
     exit(EXIT_FAILURE);
 }
 
@@ -211,11 +338,14 @@ initialize(
         shared_ptr<IdentInterface> &implPtr,
         const string &configDir,
         const string &enrollDir,
-        Action action)
+        Action action,
+        CallMeter &meter)
 {
     if (action == Action::Enroll_1N) {
         /* Initialization */
+        meter.begin();
         auto ret = implPtr->initializeEnrollmentSession(configDir);
+        meter.end(TimedCall::InitializeEnrollmentSession, 1);
         if (ret.code != ReturnCode::Success) {
             cerr << "initializeEnrollmentSession() returned error code: "
                     << to_string(ret.code) << "." << endl;
@@ -223,7 +353,9 @@ initialize(
         }
     } else if (action == Action::Search_1N) {
         /* Initialize probe feature extraction */
+        meter.begin();
         auto ret = implPtr->initializeProbeTemplateSession(configDir, enrollDir);
+        meter.end(TimedCall::InitializeProbeTemplateSession, 1);
         if (ret.code != ReturnCode::Success) {
             cerr << "initializeProbeTemplateSession() returned error code: "
                     << to_string(ret.code) << "." << endl;
@@ -231,7 +363,9 @@ initialize(
         }
 
         /* Initialize search */
+        meter.begin();
         ret = implPtr->initializeIdentificationSession(configDir, enrollDir);
+        meter.end(TimedCall::InitializeIdentificationSession, 1);
         if (ret.code != ReturnCode::Success) {
             cerr << "initializeIdentificationSession() returned error code: "
                     << to_string(ret.code) << "." << endl;
@@ -250,7 +384,10 @@ main(int argc, char* argv[])
         outputDir{"output"},
         outputFileStem{"stem"},
         inputFile;
-    int numForks = 1;
+    int numForks = 1, batchSize = 1, numThreads = 0, prefetchDepth = 0,
+            progressInterval = 0;
+    int64_t chunkSize = 0;
+    bool columnar = false, countEvents = false, timeline = false;
 
     int requiredArgs = 2; /* exec name and action */
     for (int i = 0; i < argc - requiredArgs; i++) {
@@ -266,11 +403,47 @@ main(int argc, char* argv[])
             inputFile = argv[requiredArgs+(++i)];
         else if (strcmp(argv[requiredArgs+i],"-t") == 0)
             numForks = atoi(argv[requiredArgs+(++i)]);
+        else if (strcmp(argv[requiredArgs+i],"-b") == 0)
+            batchSize = atoi(argv[requiredArgs+(++i)]);
+        else if (strcmp(argv[requiredArgs+i],"-T") == 0)
+            numThreads = atoi(argv[requiredArgs+(++i)]);
+        else if (strcmp(argv[requiredArgs+i],"-q") == 0)
+            chunkSize = atoll(argv[requiredArgs+(++i)]);
+        else if (strcmp(argv[requiredArgs+i],"-p") == 0)
+            prefetchDepth = atoi(argv[requiredArgs+(++i)]);
+        else if (strcmp(argv[requiredArgs+i],"-F") == 0) {
+            string format{argv[requiredArgs+(++i)]};
+            if (format != "text" && format != "columnar") {
+                cerr << "Unknown output format: " << format << endl;
+                usage(argv[0]);
+            }
+            columnar = (format == "columnar");
+        }
+        else if (strcmp(argv[requiredArgs+i],"-H") == 0)
+            countEvents = true;
+        else if (strcmp(argv[requiredArgs+i],"-r") == 0)
+            timeline = true;
+        else if (strcmp(argv[requiredArgs+i],"-P") == 0)
+            progressInterval = atoi(argv[requiredArgs+(++i)]);
         else {
             cerr << "Unrecognized flag: " << argv[requiredArgs+i] << endl;;
             return EXIT_FAILURE;
         }
     }
+    if (batchSize < 1) {
+        cerr << "Batch size must be at least 1." << endl;
+        usage(argv[0]);
+    }
+    if (numThreads < 0 || (numThreads > 0 && numForks > 1)) {
+        cerr << "Specify either a number of processes to fork or a number "
+                "of threads." << endl;
+        usage(argv[0]);
+    }
+    if (chunkSize < 0 || prefetchDepth < 0 || progressInterval < 0) {
+        cerr << "Chunk size, prefetch depth and progress interval must not "
+                "be negative." << endl;
+        usage(argv[0]);
+    }
 
 	auto implPtr = IdentInterface::getImplementation();
 	Action action;
@@ -285,22 +458,171 @@ main(int argc, char* argv[])
         usage(argv[0]);
 	}
 
+	/*
+	 * Time the interface calls of every worker, optionally counting
+	 * hardware events and recording a timeline, and sample the resource
+	 * usage of the parent and the workers at the end of each phase
+	 */
+	LatencyRecorder latency;
+	CounterRecorder counters;
+	ResourceRecorder resources;
+	if (!latency.create(numThreads > 0 ? numThreads : numForks) ||
+	        (countEvents && !counters.create(numThreads > 0 ? numThreads : numForks)) ||
+	        !resources.create(numThreads > 0 ? numThreads : numForks))
+	    return EXIT_FAILURE;
+	const string reportStem{outputDir + "/" + outputFileStem + "." + to_string(action)};
+	if (timeline) {
+	    traceStart(reportStem + ".trace.json");
+	    traceThread("main");
+	}
+	/* numShards is the number of forked workers whose timelines to join */
+	auto writeReports = [&](int numShards) -> int {
+	    if (latency.writeSummary(reportStem + ".latency") != SUCCESS ||
+	            resources.writeReport(reportStem + ".resources") != SUCCESS ||
+	            (countEvents && counters.writeReport(reportStem + ".counters") != SUCCESS) ||
+	            (tracing() && traceFinish(numShards, string("validate1N ") +
+	            to_string(action)) != SUCCESS))
+	        return FAILURE;
+	    return SUCCESS;
+	};
+
 	if (action == Action::Enroll_1N || action == Action::Search_1N) {
-        /* Initialization */
-        if (initialize(implPtr, configDir, enrollDir, action) != EXIT_SUCCESS)
-            return EXIT_FAILURE;
+        /* Initialization, counted on counters closed before workers start */
+        {
+            CallMeter meter(latency.worker(0), counters.worker(0));
+            if (initialize(implPtr, configDir, enrollDir, action, meter) != EXIT_SUCCESS)
+                return EXIT_FAILURE;
+        }
+        resources.sample(-1, "initialize", ResourceScope::Process);
+        if (numThreads > 0) {
+            if (!implPtr->isThreadSafe()) {
+                cerr << "The implementation does not declare itself "
+                        "thread-safe; use -t numForks instead of -T." << endl;
+                return EXIT_FAILURE;
+            }
+            numForks = numThreads;
+        }
 
-	    /* Split input file into appropriate number of splits */
-	    vector<string> inputFileVector;
-	    if (splitInputFile(inputFile, outputDir, numForks, inputFileVector) != EXIT_SUCCESS) {
+	    /*
+	     * Divide the input into appropriate number of partitions, or queue
+	     * it for the workers to claim chunkSize entries at a time
+	     */
+	    if (columnar && action == Action::Search_1N && chunkSize > 0) {
+	        cerr << "Columnar candidate lists cannot be put back in input "
+	                "order; use -F text with -q." << endl;
+	        return EXIT_FAILURE;
+	    }
+	    InputList inputList;
+	    if (inputList.open(inputFile, numForks, chunkSize) != EXIT_SUCCESS) {
 	        cerr << "An error occurred with processing the input file." << endl;
 	        return EXIT_FAILURE;
 	    }
+	    /*
+	     * Workers add their templates to one EDB and manifest, ready for
+	     * finalization as soon as they finish
+	     */
+	    SharedEDB edb;
+	    if (action == Action::Enroll_1N && !edb.create(outputDir + "/edb",
+	            outputDir + "/manifest"))
+	        return EXIT_FAILURE;
+
+	    /* Columnar candidate lists are named outputStem.search.cols.N */
+	    vector<string> logs;
+	    const string logFormat{(columnar && action == Action::Search_1N) ? ".cols" : ""};
+	    for (int i = 0; i < numForks; i++)
+	        logs.push_back(outputDir + "/" + outputFileStem + "." + to_string(action) +
+	                logFormat + "." + to_string(i));
+
+	    /* Workers count what they finish; with -P it is reported as they run */
+	    ProgressRecorder progress;
+	    if (!progress.create(numForks))
+	        return EXIT_FAILURE;
+
+	    /* Process partition i of the input */
+	    auto process = [&](int i) -> int {
+	        CallMeter meter(latency.worker(i), counters.worker(i), progress.worker(i));
+	        auto reader = inputList.reader(i);
+	        if (!reader)
+	            return FAILURE;
+	        /* Decode upcoming images while templates are created */
+	        if (prefetchDepth > 0)
+	            reader.reset(new PrefetchReader(move(reader), prefetchDepth));
+	        if (action == Action::Enroll_1N)
+	            return enroll(
+	                    implPtr,
+	                    configDir,
+	                    *reader,
+	                    logs[i],
+	                    edb,
+	                    batchSize,
+	                    meter);
+	        else
+	            return search(
+	                    implPtr,
+	                    configDir,
+	                    enrollDir,
+	                    *reader,
+	                    logs[i],
+	                    batchSize,
+	                    columnar,
+	                    meter);
+	    };
+	    /*
+	     * A thread's memory is that of the whole process.  A forked worker
+	     * hands its part of the timeline to the parent through a shard.
+	     */
+	    auto work = [&](int i) -> int {
+	        auto scope = (numThreads > 0 ? ResourceScope::Thread : ResourceScope::Process);
+	        const string name{"worker " + to_string(i)};
+	        traceThread(name);
+	        resources.sample(i, "start", scope);
+	        int status;
+	        {
+	            TraceSpan span(to_string(action));
+	            status = process(i);
+	        }
+	        progress.worker(i)->finished = 1;
+	        resources.sample(i, to_string(action), scope);
+	        if (tracing() && numThreads == 0 && traceWriteShard(i, name) != SUCCESS)
+	            status = FAILURE;
+	        return status;
+	    };
+	    /* The logs of a failed worker may be cut short, so leave them unmerged */
+	    auto combine = [&](bool workersSucceeded) -> int {
+	        if (workersSucceeded)
+	            return inputList.restoreLogOrder(logs);
+	        if (inputList.isIndexed())
+	            cerr << "Leaving the log of each worker unmerged, since a "
+	                    "worker failed." << endl;
+	        return FAILURE;
+	    };
 
-	    bool parent = false;
-	    int i = 0;
 	    ReturnStatus ret;
-	    for (auto &inputFile : inputFileVector) {
+	    if (numThreads > 0) {
+	        /*
+	         * Threads -- one thread per partition, sharing this process's
+	         * implementation instance.  Each thread writes the same per-partition
+	         * output files as a forked child would.
+	         */
+	        ret = implPtr->setGPU(0);
+	        if (ret.code != ReturnCode::Success) {
+	            cerr << "setGPU() returned error code: "
+	                    << ret.code << "." << endl;
+	            return FAILURE;
+	        }
+	        progress.startReports(progressInterval, inputList.size());
+	        auto exitStatus = runThreads(numForks, work);
+	        progress.stopReports();
+	        resources.sample(-1, "workers", ResourceScope::Process);
+	        if (combine(exitStatus == SUCCESS) != SUCCESS)
+	            exitStatus = FAILURE;
+	        if (writeReports(0) != SUCCESS)
+	            exitStatus = FAILURE;
+	        return exitStatus;
+	    }
+
+	    bool parent = false, workersSucceeded = true;
+	    for (int i = 0; i < numForks; i++) {
 	        /* Fork */
 	        switch(fork()) {
 	        case 0: /* Child */
@@ -310,50 +632,55 @@ main(int argc, char* argv[])
 	                        << ret.code << "." << endl;
 	                return FAILURE;
 	            }
-	            if (action == Action::Enroll_1N)
-	                return enroll(
-	                        implPtr,
-	                        configDir,
-	                        inputFile,
-	                        outputDir + "/" + outputFileStem + "." + to_string(action) + "." + to_string(i),
-	                        outputDir + "/edb." + to_string(i),
-	                        outputDir + "/manifest." + to_string(i));
-	            else if (action == Action::Search_1N)
-	                return search(
-	                        implPtr,
-	                        configDir,
-	                        enrollDir,
-	                        inputFile,
-	                        outputDir + "/" + outputFileStem + "." + to_string(action) + "." + to_string(i));
+	            return work(i);
 	        case -1: /* Error */
 	            cerr << "Problem forking" << endl;
+	            workersSucceeded = false;
 	            break;
 	        default: /* Parent */
 	            parent = true;
 	            break;
 	        }
-	        i++;
 	    }
 
 	    /* Parent -- wait for children */
 	    if (parent) {
+	        progress.startReports(progressInterval, inputList.size());
 	        while (numForks > 0) {
 	            int stat_val;
 	            pid_t cpid;
 
 	            cpid = wait(&stat_val);
-	            if (WIFEXITED(stat_val)) {}
-	            else if (WIFSIGNALED(stat_val))
+	            if (WIFEXITED(stat_val)) {
+	                if (WEXITSTATUS(stat_val) != SUCCESS) {
+	                    cerr << "PID " << cpid << " exited with status " <<
+	                            WEXITSTATUS(stat_val) << endl;
+	                    workersSucceeded = false;
+	                }
+	            } else if (WIFSIGNALED(stat_val)) {
 	                cerr << "PID " << cpid << " exited due to signal " <<
 	                        WTERMSIG(stat_val) << endl;
-	            else
+	                workersSucceeded = false;
+	            } else {
 	                cerr << "PID " << cpid << " exited with unknown status." << endl;
+	                workersSucceeded = false;
+	            }
 
 	            numForks--;
 	        }
+	        progress.stopReports();
+	        resources.sample(-1, "workers", ResourceScope::Process);
+	        resources.sample(-1, "children", ResourceScope::Children);
+	        auto status = combine(workersSucceeded);
+	        if (writeReports(logs.size()) != SUCCESS || status != SUCCESS)
+	            return EXIT_FAILURE;
 	    }
 	} else if (action == Action::Finalize_1N) {
-	    return finalize(implPtr, outputDir, enrollDir);
+	    CallMeter meter(latency.worker(0), counters.worker(0));
+	    if (finalize(implPtr, outputDir, enrollDir, meter) != SUCCESS)
+	        return FAILURE;
+	    resources.sample(-1, "finalize", ResourceScope::Process);
+	    return writeReports(0);
 	}
 
 	return EXIT_SUCCESS;